@@ -1,9 +1,28 @@
 #include <x86intrin.h>
 
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 
 #include "btree.h"
+#ifdef USE_BWTREE
+#include "bwtree.h"
+using IndexType = BwTree;
+#define RESULTS_DIR "/mydata/LSM-vs-BTREE/bwtree_results/"
+#elif defined(USE_PARTITIONED)
+#include "partitioned_btree.h"
+using IndexType = PartitionedBPlusTree;
+#define RESULTS_DIR "/mydata/LSM-vs-BTREE/partitioned_results/"
+#elif defined(USE_VARKEY)
+#include "varkey_btree.h"
+using IndexType = VarKeyBPlusTree;
+#define RESULTS_DIR "/mydata/LSM-vs-BTREE/varkey_results/"
+#else
+#include "frozen_index.h"
+using IndexType = BPlusTree;
+#define INDEX_IS_BPLUSTREE  // checkpoint, leaf merging, page tracing and frozen reads are BPlusTree-only
+#define RESULTS_DIR "/mydata/LSM-vs-BTREE/btree_results/"
+#endif
 #include "/mydata/LSM-vs-BTREE/zipf_implementation.h"
 // #include "common.h"
 #include <cassert>
@@ -32,7 +51,10 @@ std::string results_FILE = "c.csv";
 std::atomic<int> total_reads(0);
 std::atomic<int> total_writes(0);
 std::mutex latency_mutex;
-std::vector<uint64_t> total_accessed_page_numbers;
+#ifdef INDEX_IS_BPLUSTREE
+// Read-only replica serving GETs when FROZEN_READS is set; only used for read-only mixes
+FrozenIndex* frozen_replica = nullptr;
+#endif
 
 class CSVLogger {
 public:
@@ -66,6 +88,20 @@ public:
     std::ofstream file_;
 };
 
+#ifdef USE_VARKEY
+// YCSB-style string key for record i: "user" followed by the FNV-1a hash of i
+std::string index_key(uint64_t i) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int b = 0; b < 8; b++) {
+        h ^= (i >> (8 * b)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    return "user" + std::to_string(h);
+}
+#else
+uint64_t index_key(uint64_t i) { return i; }
+#endif
+
 // Generate random VALUE_SIZE-byte values
 std::string generate_random_value() {
     std::string value(VALUE_SIZE, ' ');
@@ -132,7 +168,7 @@ std::vector<std::pair<uint64_t, char>> generate_random_ops_just_one(
 }
 
 // Worker thread for GET
-void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, int end, int thread_id, BPlusTree* tree, std::vector<double>& local_read_latencies, std::vector<double>& local_write_latencies) {
+void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, int end, int thread_id, IndexType* tree, std::vector<double>& local_read_latencies, std::vector<double>& local_write_latencies) {
     {
         struct bitmask* cpus = numa_allocate_cpumask();
         numa_node_to_cpus((thread_id % NUM_EXEC_NODES) + 1, cpus);
@@ -167,7 +203,12 @@ void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, in
         write_ratio = 0.5;
     } else if (results_FILE == "b.csv") {
         write_ratio = 0.05;
+    } else if (results_FILE == "f.csv") {
+        write_ratio = 0.5;  // YCSB-F: 50% reads, 50% read-modify-writes
     }
+    bool read_modify_write = results_FILE == "f.csv";
+    // Counter-style modification applied in place by upsert
+    auto bump_value = [](std::string& v) { v.back() = v.back() == 'z' ? 'a' : v.back() + 1; };
     ScrambledZipfianGenerator zipf(TOTAL_KEYS, ZIPF_CONST, write_ratio);
     off_t key = 1;
     char op = 'R';
@@ -180,9 +221,15 @@ void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, in
             std::string val;
             key = zipf.Next();
             op = zipf.get_op();
+            auto k = index_key(key);
+            if (op == 'U' && read_modify_write) op = 'M';
             if (op == 'R') {
                 t1 = __rdtscp(&tsc_aux);
-                found = tree->get(key, val);
+#ifdef INDEX_IS_BPLUSTREE
+                found = frozen_replica ? frozen_replica->get(k, val) : tree->get(k, val);
+#else
+                found = tree->get(k, val);
+#endif
                 t2 = __rdtscp(&tsc_aux);
                 if (!found) {
                     std::cerr << "Key not found: " << key << "\n";
@@ -192,11 +239,18 @@ void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, in
                 found = false;
             } else if (op == 'U' || op == 'I') {
                 t1 = __rdtscp(&tsc_aux);
-                tree->put(key, val_to_insert);
+                tree->put(k, val_to_insert);
                 t2 = __rdtscp(&tsc_aux);
                 auto duration = cycles_to_nanoseconds(t2 - t1, CPU_FREQ_GHZ);
                 local_write_latencies.push_back(duration);
                 found = false;
+            } else if (op == 'M') {
+                // Read-modify-write in one traversal; counted with the writes
+                t1 = __rdtscp(&tsc_aux);
+                tree->upsert(k, val_to_insert, bump_value);
+                t2 = __rdtscp(&tsc_aux);
+                auto duration = cycles_to_nanoseconds(t2 - t1, CPU_FREQ_GHZ);
+                local_write_latencies.push_back(duration);
             }
         }
         end_thread_time = std::chrono::high_resolution_clock::now();
@@ -209,7 +263,7 @@ void worker_get(const std::vector<std::pair<uint64_t, char>>& ops, int start, in
 
 // The benchmark
 void benchmark(int num_threads, const std::vector<std::pair<uint64_t, std::string>>& data,
-               const std::vector<std::pair<uint64_t, char>>& ops, CSVLogger& logger, CSVLogger& pagenumbers, BPlusTree* tree) {
+               const std::vector<std::pair<uint64_t, char>>& ops, CSVLogger& logger, IndexType* tree) {
     std::vector<std::thread> threads;
     threads.reserve(num_threads);
     std::vector<std::vector<double>> thread_read_latencies(num_threads);
@@ -274,12 +328,6 @@ void benchmark(int num_threads, const std::vector<std::pair<uint64_t, std::strin
 
     logger.writeRow({std::to_string(num_threads), std::to_string(throughput), std::to_string(avgLat),
                      std::to_string(avgReadLat), std::to_string(avgWriteLat)});
-    if (total_accessed_page_numbers.size() > 0) {
-        std::cout << "Total accessed page numbers: " << total_accessed_page_numbers.size() << "\n";
-        for (auto page_number : total_accessed_page_numbers) {
-            pagenumbers.writeRow({std::to_string(page_number)});
-        }
-    }
 }
 
 // main
@@ -288,13 +336,9 @@ int main(int argc, char* argv[]) {
         results_FILE = argv[2];
     }
     std::cout << "Results file: " << results_FILE << "\n";
-    std::string log_path = "/mydata/LSM-vs-BTREE/btree_results/" + results_FILE;
+    std::string log_path = RESULTS_DIR + results_FILE;
     CSVLogger logger(log_path, {"Thread Count", "Throughput (ops/s)", "Avg Latency (ns/op)", "Avg Read Latency (ns/op)",
                                 "Avg Write Latency (ns/op)"});
-    CSVLogger pagenumbers("/mydata/pages.csv", {"page numbers"});
-    if (!pagenumbers.file_.is_open()) {
-        std::cerr << "Failed to open CSV file: /mydata/pages.csv. Please check that the directory exists and is writable.\n";
-    }
     // CSVLogger logger("/mydata/results_local.csv", {"Thread Count", "Throughput (ops/s)", "Avg Latency (ns/op)"});
 
     numa_set_strict(1);
@@ -310,13 +354,53 @@ int main(int argc, char* argv[]) {
 
     pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
     try {
-        BPlusTree tree;
+#ifdef USE_PARTITIONED
+        // One partition per execution node, placed where the workers run; DELEGATION=1
+        // routes writes through each partition's owner thread
+        std::vector<int> partition_nodes;
+        for (int n = 1; n <= NUM_EXEC_NODES; n++) partition_nodes.push_back(n);
+        IndexType tree(NUM_EXEC_NODES, TOTAL_KEYS, std::getenv("DELEGATION") != nullptr, partition_nodes);
+#else
+        IndexType tree;
+#endif
         auto data = generate_data();
         std::cout << "Creating B+ Tree and inserting data...\n";
         for (auto& kv : data) {
-            tree.put(kv.first, kv.second);
+            tree.put(index_key(kv.first), kv.second);
         }
         std::cout << "Inserted " << data.size() << " random key/value pairs.\n";
+#ifdef INDEX_IS_BPLUSTREE
+        double load_fill = tree.leafFillFactor();
+        std::cout << "Leaf fill factor after load: " << load_fill << "\n";
+        // MERGE_LEAVES=1 merges underfull sibling leaves after the load; MERGE_LEAVES=bg
+        // instead runs the merge pass every 100 ms alongside the benchmark ops
+        const char* merge_leaves = std::getenv("MERGE_LEAVES");
+        bool background_merge = merge_leaves && std::string(merge_leaves) == "bg";
+        if (merge_leaves && !background_merge) {
+            size_t mergedLeaves = tree.mergeUnderfullLeaves();
+            std::cout << "Merged " << mergedLeaves << " underfull leaves, fill factor now " << tree.leafFillFactor()
+                      << "\n";
+        }
+        // RELAYOUT=1 renumbers the loaded tree in van Emde Boas order (RELAYOUT=bfs: breadth-first)
+        if (const char* relayout_order = std::getenv("RELAYOUT")) {
+            bool bfs = std::string(relayout_order) == "bfs";
+            auto relayout_start = std::chrono::high_resolution_clock::now();
+            tree.relayout(bfs ? LayoutOrder::BreadthFirst : LayoutOrder::VanEmdeBoas);
+            std::cout << "Relaid out nodes in " << (bfs ? "breadth-first" : "van Emde Boas") << " order in "
+                      << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - relayout_start)
+                             .count()
+                      << " s\n";
+        }
+        // Optional third argument: checkpoint the loaded tree there and restore it back.
+        if (argc > 3) {
+            CheckpointStats ckpt = tree.checkpoint(argv[3]);
+            std::cout << "Checkpoint: " << ckpt.bytes / (1024.0 * 1024.0) << " MB in " << ckpt.seconds << " s ("
+                      << ckpt.bandwidthMBps() << " MB/s)\n";
+            CheckpointStats rst = tree.restore(argv[3]);
+            std::cout << "Restore: " << rst.bytes / (1024.0 * 1024.0) << " MB in " << rst.seconds << " s ("
+                      << rst.bandwidthMBps() << " MB/s)\n";
+        }
+#endif
         // auto tmp = tree.rangeQuery(1, 50);
         // std::cout << "Range query result size: " << tmp.size() << "\n";
         // for (auto& kv : tmp) {
@@ -327,13 +411,49 @@ int main(int argc, char* argv[]) {
         auto ops = generate_random_ops_just_one(data);
         // auto ops = read_ops_from_file();
 
+#ifdef INDEX_IS_BPLUSTREE
+        // PAGE_TRACE=<path> records every node visited by the benchmark ops (not the load) to <path>
+        const char* page_trace_path = std::getenv("PAGE_TRACE");
+        if (page_trace_path) tree.page_trace.enable();
+        // FROZEN_READS=1 serves YCSB-C reads from an immutable SIMD replica of the tree
+        std::unique_ptr<FrozenIndex> frozen;
+        if (std::getenv("FROZEN_READS")) {
+            if (results_FILE != "c.csv") {
+                std::cerr << "FROZEN_READS ignored: " << results_FILE << " has writes\n";
+            } else {
+                auto freeze_start = std::chrono::high_resolution_clock::now();
+                frozen = std::make_unique<FrozenIndex>(tree);
+                frozen_replica = frozen.get();
+                std::cout << "Froze " << frozen->size() << " keys ("
+                          << frozen->memoryBytes() / (1024.0 * 1024.0) << " MB) in "
+                          << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - freeze_start)
+                                 .count()
+                          << " s\n";
+            }
+        }
+        if (background_merge) tree.startBackgroundMerge(std::chrono::milliseconds(100));
+#endif
         if (argc > 1) {
             int Number_of_threads = std::stoi(argv[1]);
-            benchmark(Number_of_threads, data, ops, logger, pagenumbers, &tree);
+            benchmark(Number_of_threads, data, ops, logger, &tree);
         } else {
             std::cout << "No batch number provided. Running with 1 thread.\n";
-            benchmark(1, data, ops, logger, pagenumbers, &tree);
+            benchmark(1, data, ops, logger, &tree);
         }
+#ifdef INDEX_IS_BPLUSTREE
+        if (background_merge) {
+            tree.stopBackgroundMerge();
+            std::cout << "Leaf fill factor with background merging: " << load_fill << " before, "
+                      << tree.leafFillFactor() << " after\n";
+        }
+        if (page_trace_path) {
+            tree.page_trace.disable();
+            uint64_t traced = tree.page_trace.recorded();
+            uint64_t kept = tree.page_trace.dump(page_trace_path);
+            std::cout << "Page trace: " << kept << " of " << traced << " node visits written to " << page_trace_path
+                      << "\n";
+        }
+#endif
 
         std::cout << "Done.\n";
         {
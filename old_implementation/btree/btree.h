@@ -1,13 +1,20 @@
+#ifndef BTREE_H
+#define BTREE_H
+
 #include <fcntl.h>
 #include <numa.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
@@ -18,6 +25,9 @@
 #include <vector>
 #include <memory>
 #include <shared_mutex>
+#include <set>
+
+#include "page_trace.h"
 
 #define MAX_RANGE_RESULTS 1000
 
@@ -31,10 +41,20 @@ int64_t cycles_to_nanoseconds(uint64_t cycles, double cpu_frequency_ghz) {
 static const size_t NODE_SIZE = 4096;  // 4 KB node size
 static const uint8_t NODE_TYPE_INTERNAL = 0;
 static const uint8_t NODE_TYPE_LEAF = 1;
+static const uint8_t NODE_TYPE_FREE = 2;  // checkpoint slot of a reclaimed node
+
+static const uint32_t CHECKPOINT_MAGIC = 0xB7EE0002;
+static const size_t CHECKPOINT_CHUNK_NODES = 256;  // 1 MB per I/O
 
 static const int MAX_KEYS_INTERNAL = 120;
 static const int MAX_KEYS_LEAF = 30;
 
+// Adaptive splits: a node split by an append (or prepend) run keeps this share of
+// the keys on the side that will not receive further inserts.
+static const double SPLIT_APPEND_FRACTION = 0.9;
+// Sibling leaves are merged when one is below this fill and both fit in one leaf.
+static const double LEAF_MERGE_FILL_THRESHOLD = 0.5;
+
 // -----------------------------------------------------------------------------
 // On-disk structures (packed)
 // -----------------------------------------------------------------------------
@@ -48,9 +68,10 @@ struct InternalNodeDisk {
 };
 
 struct LeafRecord {
-    uint64_t key_padding[2];  // padding to align to 16 bytes
+    uint64_t valueLen;     // bytes of value in use; values may hold NULs
+    uint64_t key_padding;  // padding to align to 16 bytes
     uint64_t key;
-    char value[8];  // fixed 8-byte value
+    char value[8];  // up to 8 bytes of value
 };
 
 struct LeafNodeDisk {
@@ -72,6 +93,13 @@ static_assert(sizeof(LeafNodeDisk) <= NODE_SIZE, "LeafNodeDisk size must be 16 b
 static_assert(sizeof(Superblock) <= NODE_SIZE, "Superblock size must be 16 bytes");
 #pragma pack(pop)
 
+// Bytes moved and wall time of a checkpoint() or restore() call
+struct CheckpointStats {
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    double bandwidthMBps() const { return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+};
+
 // -----------------------------------------------------------------------------
 // InsertResult struct for handling node splits
 // -----------------------------------------------------------------------------
@@ -79,6 +107,9 @@ struct InsertResult {
     bool splitted;            // true if the child node was split
     uint64_t newChildOffset;  // offset of new sibling node
     uint64_t promotedKey;     // key to be promoted up to the parent
+    uint64_t replacedOffset = SIZE_MAX;  // copy-on-write shadow that replaces the child, if any
+    uint64_t relinkLeaf = SIZE_MAX;      // shadowed leaf whose predecessor's nextLeaf must be repointed
+    int splitBias = 0;                   // +1 / -1 if the split came from an ascending / descending run
 };
 
 // -----------------------------------------------------------------------------
@@ -96,22 +127,84 @@ struct LeafNode {
     std::vector<uint64_t> keys;
     std::vector<std::string> values;
     size_t nextLeaf; // index of next leaf, or SIZE_MAX for null
-    LeafNode() : numKeys(0), keys(MAX_KEYS_LEAF), values(MAX_KEYS_LEAF), nextLeaf(SIZE_MAX) {}
+    int32_t lastInsertPos; // slot of the previous insert, -1 if unknown (append detection)
+    LeafNode() : numKeys(0), keys(MAX_KEYS_LEAF), values(MAX_KEYS_LEAF), nextLeaf(SIZE_MAX), lastInsertPos(-1) {}
+};
+
+enum class SplitPolicy {
+    Middle,    // always split at the midpoint
+    Adaptive,  // 90/10 split for append/prepend runs, midpoint otherwise
 };
 
 enum class NodeType { Internal, Leaf };
 
+// Node order produced by BPlusTree::relayout()
+enum class LayoutOrder {
+    BreadthFirst,  // level by level, siblings adjacent
+    VanEmdeBoas,   // recursive top/bottom halves, so a root-to-leaf path touches few regions
+};
+
+// In-place value modifier for read-modify-write operations
+using ValueUpdater = std::function<void(std::string &)>;
+
+// Options threaded down the insert path by update()/upsert(); put passes none.
+struct WriteOp {
+    const ValueUpdater *updater = nullptr;  // applied to an existing value instead of overwriting it
+    bool insertIfMissing = true;            // false for update(): a missing key is left alone
+    bool applied = false;                   // set once the leaf was modified
+};
+
 struct Node {
     NodeType type;
     std::unique_ptr<InternalNode> internal;
     std::unique_ptr<LeafNode> leaf;
     mutable std::shared_mutex node_mutex; // Fine-grained lock for this node
+    uint64_t version = 0;  // write version that created this node (copy-on-write)
     Node(NodeType t) : type(t), internal(nullptr), leaf(nullptr) {
         if (t == NodeType::Internal) internal = std::make_unique<InternalNode>();
         else leaf = std::make_unique<LeafNode>();
     }
 };
 
+// -----------------------------------------------------------------------------
+// NodeArena: node slots with stable addresses
+// -----------------------------------------------------------------------------
+// Slots live in fixed-size chunks that never move once allocated, so lock-free
+// snapshot readers and counted ops can index the arena while a writer appends to it
+// (a std::vector would reallocate under them). Appends, truncate and clear must be
+// serialized by the caller.
+class NodeArena {
+public:
+    static const size_t CHUNK_SLOTS = 4096;
+    static const size_t MAX_CHUNKS = 65536;  // 256M nodes
+
+    NodeArena() : chunks_(MAX_CHUNKS) {}
+
+    std::unique_ptr<Node> &operator[](size_t i) { return chunks_[i / CHUNK_SLOTS][i % CHUNK_SLOTS]; }
+    const std::unique_ptr<Node> &operator[](size_t i) const { return chunks_[i / CHUNK_SLOTS][i % CHUNK_SLOTS]; }
+    size_t size() const { return size_; }
+
+    void emplace_back(std::unique_ptr<Node> node) {
+        size_t chunk = size_ / CHUNK_SLOTS;
+        if (chunk >= MAX_CHUNKS) throw std::runtime_error("NodeArena: out of node slots");
+        if (!chunks_[chunk]) chunks_[chunk] = std::make_unique<std::unique_ptr<Node>[]>(CHUNK_SLOTS);
+        chunks_[chunk][size_ % CHUNK_SLOTS] = std::move(node);
+        size_++;
+    }
+
+    // Frees the slots from n on; their chunks are kept for later appends
+    void truncate(size_t n) {
+        for (size_t i = n; i < size_; i++) (*this)[i].reset();
+        size_ = std::min(size_, n);
+    }
+
+    void clear() { truncate(0); }
+
+private:
+    std::vector<std::unique_ptr<std::unique_ptr<Node>[]>> chunks_;  // sized once, never reallocated
+    size_t size_ = 0;
+};
+
 // -----------------------------------------------------------------------------
 // BPlusTree Class (in-memory, index-based)
 // -----------------------------------------------------------------------------
@@ -122,43 +215,52 @@ public:
         rootIndex_ = allocateLeaf();
     }
 
+    ~BPlusTree() { stopBackgroundMerge(); }
+
+    void setSplitPolicy(SplitPolicy policy) { splitPolicy_ = policy; }
+
     // Insert or update
-    void put(uint64_t key, const std::string &value) {
-        if (rootIndex_ == SIZE_MAX) {
-            std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
-            rootIndex_ = allocateLeaf();
-            std::unique_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);
-            nodes_[rootIndex_]->leaf->keys[0] = key;
-            nodes_[rootIndex_]->leaf->values[0] = value;
-            nodes_[rootIndex_]->leaf->numKeys = 1;
-            return;
-        }
-        InsertResult result = insertInternal(rootIndex_, key, value);
-        if (result.splitted) {
-            std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
-            uint64_t newRoot = allocateNode();
-            std::unique_lock<std::shared_mutex> newRootLock(nodes_[newRoot]->node_mutex);
-            nodes_[newRoot]->internal->keys[0] = result.promotedKey;
-            nodes_[newRoot]->internal->childIndices[0] = rootIndex_;
-            nodes_[newRoot]->internal->childIndices[1] = result.newChildOffset;
-            nodes_[newRoot]->internal->numKeys = 1;
-            rootIndex_ = newRoot;
-        }
+    void put(uint64_t key, const std::string &value) { write(key, value, nullptr); }
+
+    // Applies fn to the value of key in place, under the leaf's exclusive lock and in
+    // a single traversal. Returns false (and does nothing) if key is absent.
+    bool update(uint64_t key, const ValueUpdater &fn) {
+        WriteOp op;
+        op.updater = &fn;
+        op.insertIfMissing = false;
+        write(key, std::string(), &op);
+        return op.applied;
+    }
+
+    // Like update(), but inserts defaultValue (without applying fn) if key is absent.
+    void upsert(uint64_t key, const std::string &defaultValue, const ValueUpdater &fn) {
+        WriteOp op;
+        op.updater = &fn;
+        write(key, defaultValue, &op);
     }
 
     // Get
     bool get(uint64_t key, std::string &outValue) {
-        if (rootIndex_ == SIZE_MAX) return false;
-        return searchKey(rootIndex_, key, outValue);
+        OpGuard guard(active_ops_);
+        uint64_t root;
+        std::shared_lock<std::shared_mutex> rootLock;
+        if (!lockRoot(root, rootLock, guard)) return false;
+        return searchKey(root, std::move(rootLock), key, outValue);
     }
 
     std::vector<std::pair<uint64_t, std::string>> rangeQuery(uint64_t low, uint64_t high,
                                                              size_t max_results = MAX_RANGE_RESULTS) {
         std::vector<std::pair<uint64_t, std::string>> out;
         if (rootIndex_ == SIZE_MAX || low > high) return out;
-        uint64_t leafOff = findLeafForKey(rootIndex_, low);
+        OpGuard guard(active_ops_);
+        int leafLevel = 0;
+        uint64_t root;
+        std::shared_lock<std::shared_mutex> rootLock;
+        if (!lockRoot(root, rootLock, guard)) return out;
+        uint64_t leafOff = findLeafForKey(root, std::move(rootLock), low, 0, &leafLevel);
         while (leafOff != SIZE_MAX && out.size() < max_results) {
             std::shared_lock<std::shared_mutex> leafLock(nodes_[leafOff]->node_mutex);
+            PAGE_TRACE(page_trace, leafOff, leafLevel, TraceOp::Scan);
             LeafNode *leaf = nodes_[leafOff]->leaf.get();
             for (uint32_t i = 0; i < leaf->numKeys && out.size() < max_results; ++i) {
                 uint64_t k = leaf->keys[i];
@@ -171,6 +273,348 @@ public:
         return out;
     }
 
+    // ------------------------------------------------
+    // Snapshots (copy-on-write shadowing)
+    // ------------------------------------------------
+    // A Snapshot pins the tree as of snapshot(). While any snapshot is live, writers
+    // copy every node on their path that a snapshot can see instead of updating it
+    // in place, so snapshot reads need no locks; nodes_ never moves a slot, so they
+    // may run while writers allocate. Snapshot scans descend the tree
+    // rather than following nextLeaf, which is only kept current for the live tree.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot &&other) noexcept : tree_(other.tree_), root_(other.root_), version_(other.version_) {
+            other.tree_ = nullptr;
+        }
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        Snapshot &operator=(Snapshot &&) = delete;
+        ~Snapshot() {
+            if (tree_) tree_->releaseSnapshot(version_);
+        }
+
+        bool get(uint64_t key, std::string &outValue) const {
+            uint64_t nodeOffset = root_;
+            while (nodeOffset != SIZE_MAX) {
+                const Node *node = tree_->nodes_[nodeOffset].get();
+                if (node->type == NodeType::Leaf) {
+                    const LeafNode *leaf = node->leaf.get();
+                    for (uint32_t i = 0; i < leaf->numKeys; i++) {
+                        if (leaf->keys[i] == key) {
+                            outValue = leaf->values[i];
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                const InternalNode *internal = node->internal.get();
+                uint32_t i = 0;
+                while (i < internal->numKeys && key >= internal->keys[i]) i++;
+                nodeOffset = internal->childIndices[i];
+            }
+            return false;
+        }
+
+        std::vector<std::pair<uint64_t, std::string>> rangeQuery(uint64_t low, uint64_t high,
+                                                                 size_t max_results = MAX_RANGE_RESULTS) const {
+            std::vector<std::pair<uint64_t, std::string>> out;
+            if (root_ == SIZE_MAX || low > high) return out;
+            collectRange(root_, low, high, max_results, out);
+            return out;
+        }
+
+        uint64_t version() const { return version_; }
+
+    private:
+        friend class BPlusTree;
+        Snapshot(BPlusTree *tree, size_t root, uint64_t version) : tree_(tree), root_(root), version_(version) {}
+
+        // Returns false once the scan has passed high or filled max_results.
+        bool collectRange(uint64_t nodeOffset, uint64_t low, uint64_t high, size_t max_results,
+                          std::vector<std::pair<uint64_t, std::string>> &out) const {
+            const Node *node = tree_->nodes_[nodeOffset].get();
+            if (node->type == NodeType::Leaf) {
+                const LeafNode *leaf = node->leaf.get();
+                for (uint32_t i = 0; i < leaf->numKeys; ++i) {
+                    if (out.size() >= max_results) return false;
+                    uint64_t k = leaf->keys[i];
+                    if (k < low) continue;
+                    if (k > high) return false;
+                    out.emplace_back(k, leaf->values[i]);
+                }
+                return true;
+            }
+            const InternalNode *internal = node->internal.get();
+            uint32_t i = 0;
+            while (i < internal->numKeys && low >= internal->keys[i]) i++;
+            for (; i <= internal->numKeys; i++) {
+                if (i > 0 && internal->keys[i - 1] > high) return false;
+                if (!collectRange(internal->childIndices[i], low, high, max_results, out)) return false;
+            }
+            return true;
+        }
+
+        BPlusTree *tree_;
+        size_t root_;
+        uint64_t version_;
+    };
+
+    Snapshot snapshot() {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        // A writer holds the root exclusively for its whole insert; wait out the one in flight
+        std::unique_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);
+        uint64_t version = writeVersion_++;
+        liveSnapshots_.insert(version);
+        maxLiveSnapshot_ = version;
+        return Snapshot(this, rootIndex_, version);
+    }
+
+    // ------------------------------------------------
+    // Checkpoint / restore
+    // ------------------------------------------------
+    // The arena is dumped as a flat array: a Superblock followed by one NODE_SIZE
+    // slot per entry of nodes_, encoded with the packed *Disk structs. Child and
+    // nextLeaf indices are stored as-is since slot i is nodes_[i]. Values are stored
+    // with their length in 8-byte records (VALUE_SIZE in the benchmark); longer values
+    // are rejected.
+    CheckpointStats checkpoint(const std::string &path, unsigned numThreads = std::thread::hardware_concurrency()) {
+        std::shared_lock<std::shared_mutex> treeLock(tree_mutex);  // keeps root swaps out
+        std::shared_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);  // and other writers
+        auto start = std::chrono::high_resolution_clock::now();
+        int fd = openCheckpointFile(path, O_WRONLY | O_CREAT | O_TRUNC);
+        size_t numNodes = nodes_.size();
+        uint64_t fileSize = (numNodes + 1) * NODE_SIZE;
+
+        char *super = allocAligned(NODE_SIZE);
+        Superblock *sb = reinterpret_cast<Superblock *>(super);
+        sb->magic = CHECKPOINT_MAGIC;
+        sb->rootNodeOffset = rootIndex_;
+        sb->currentEndOffset = numNodes;
+        ssize_t rc = pwrite(fd, super, NODE_SIZE, 0);
+        free(super);
+        if (rc != (ssize_t)NODE_SIZE) {
+            close(fd);
+            throw std::runtime_error("checkpoint: failed to write superblock to " + path);
+        }
+
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<bool> failed{false};
+        size_t numChunks = (numNodes + CHECKPOINT_CHUNK_NODES - 1) / CHECKPOINT_CHUNK_NODES;
+        runParallel(numThreads, [&]() {
+            char *buf = allocAligned(CHECKPOINT_CHUNK_NODES * NODE_SIZE);
+            size_t chunk;
+            while (!failed && (chunk = nextChunk.fetch_add(1)) < numChunks) {
+                size_t first = chunk * CHECKPOINT_CHUNK_NODES;
+                size_t count = std::min(CHECKPOINT_CHUNK_NODES, numNodes - first);
+                std::memset(buf, 0, count * NODE_SIZE);
+                for (size_t i = 0; i < count; i++) {
+                    if (!encodeNode(first + i, buf + i * NODE_SIZE)) failed = true;
+                }
+                size_t len = count * NODE_SIZE;
+                if (pwrite(fd, buf, len, (first + 1) * NODE_SIZE) != (ssize_t)len) failed = true;
+            }
+            free(buf);
+        });
+        bool synced = fsync(fd) == 0;
+        close(fd);
+        if (failed || !synced) throw std::runtime_error("checkpoint: failed to write " + path);
+
+        CheckpointStats stats;
+        stats.bytes = fileSize;
+        stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        return stats;
+    }
+
+    // Replaces the whole tree with the checkpoint at path. Must not race with snapshots.
+    CheckpointStats restore(const std::string &path, unsigned numThreads = std::thread::hardware_concurrency()) {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        if (!liveSnapshots_.empty()) throw std::runtime_error("restore: snapshots are still live");
+        quiesce();
+        auto start = std::chrono::high_resolution_clock::now();
+        int fd = openCheckpointFile(path, O_RDONLY);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)NODE_SIZE || st.st_size % NODE_SIZE != 0) {
+            close(fd);
+            throw std::runtime_error("restore: " + path + " is not a checkpoint");
+        }
+        uint64_t fileSize = st.st_size;
+
+        // One bulk read of the whole file, issued as parallel chunked preads.
+        char *image = allocAligned(fileSize);
+        size_t numSlots = fileSize / NODE_SIZE;
+        size_t numChunks = (numSlots + CHECKPOINT_CHUNK_NODES - 1) / CHECKPOINT_CHUNK_NODES;
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<bool> failed{false};
+        runParallel(numThreads, [&]() {
+            size_t chunk;
+            while (!failed && (chunk = nextChunk.fetch_add(1)) < numChunks) {
+                size_t off = chunk * CHECKPOINT_CHUNK_NODES * NODE_SIZE;
+                size_t len = std::min<size_t>(CHECKPOINT_CHUNK_NODES * NODE_SIZE, fileSize - off);
+                if (pread(fd, image + off, len, off) != (ssize_t)len) failed = true;
+            }
+        });
+        close(fd);
+        const Superblock *sb = reinterpret_cast<const Superblock *>(image);
+        if (failed || sb->magic != CHECKPOINT_MAGIC || sb->currentEndOffset + 1 != numSlots) {
+            free(image);
+            throw std::runtime_error("restore: failed to read checkpoint " + path);
+        }
+
+        size_t numNodes = sb->currentEndOffset;
+        uint64_t root = sb->rootNodeOffset;
+        std::vector<std::unique_ptr<Node>> restored(numNodes);
+        std::atomic<size_t> nextDecode{0};
+        size_t decodeChunks = (numNodes + CHECKPOINT_CHUNK_NODES - 1) / CHECKPOINT_CHUNK_NODES;
+        runParallel(numThreads, [&]() {
+            size_t chunk;
+            while (!failed && (chunk = nextDecode.fetch_add(1)) < decodeChunks) {
+                size_t first = chunk * CHECKPOINT_CHUNK_NODES;
+                size_t last = std::min(first + CHECKPOINT_CHUNK_NODES, numNodes);
+                for (size_t i = first; i < last; i++) {
+                    if (!decodeNode(image + (i + 1) * NODE_SIZE, numNodes, restored[i])) failed = true;
+                }
+            }
+        });
+        free(image);
+        // Links into free slots would be dereferenced later; indices were range-checked above
+        if (!failed && (root >= numNodes || !restored[root])) failed = true;
+        for (size_t i = 0; i < numNodes && !failed; i++) {
+            const Node *node = restored[i].get();
+            if (!node) continue;
+            if (node->type == NodeType::Leaf) {
+                if (node->leaf->nextLeaf != SIZE_MAX && !restored[node->leaf->nextLeaf]) failed = true;
+                continue;
+            }
+            for (uint32_t c = 0; c <= node->internal->numKeys; c++) {
+                if (!restored[node->internal->childIndices[c]]) failed = true;
+            }
+        }
+        if (failed) throw std::runtime_error("restore: " + path + " is corrupt");
+        rootIndex_ = root;
+
+        nodes_.clear();
+        for (auto &node : restored) nodes_.emplace_back(std::move(node));
+        retired_.clear();
+        freeNodes_.clear();
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            if (!nodes_[i]) freeNodes_.push_back(i);
+        }
+
+        CheckpointStats stats;
+        stats.bytes = fileSize;
+        stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        return stats;
+    }
+
+    // ------------------------------------------------
+    // Leaf merging
+    // ------------------------------------------------
+    // Merges adjacent sibling leaves when one is under LEAF_MERGE_FILL_THRESHOLD and
+    // their keys fit in a single leaf. Gets, scans and writes pause for the pass.
+    // Skipped while a snapshot is live, since merged leaves would need shadowing.
+    // Returns the number of leaves removed.
+    size_t mergeUnderfullLeaves() {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        if (rootIndex_ == SIZE_MAX || maxLiveSnapshot_ != 0) return 0;
+        quiesce();
+        if (nodes_[rootIndex_]->type == NodeType::Leaf) return 0;
+        size_t merged = mergeLeavesBelow(rootIndex_);
+        // Collapse a root left with a single child
+        while (nodes_[rootIndex_]->type == NodeType::Internal && nodes_[rootIndex_]->internal->numKeys == 0) {
+            uint64_t oldRoot = rootIndex_;
+            std::unique_lock<std::shared_mutex> rootLock(nodes_[oldRoot]->node_mutex);
+            rootIndex_ = nodes_[oldRoot]->internal->childIndices[0];
+            retired_.emplace_back(writeVersion_, oldRoot);
+        }
+        reclaimRetired();
+        return merged;
+    }
+
+    // Runs mergeUnderfullLeaves every interval until stopBackgroundMerge() or destruction.
+    void startBackgroundMerge(std::chrono::milliseconds interval) {
+        stopBackgroundMerge();
+        mergeStop_ = false;
+        mergeThread_ = std::thread([this, interval] {
+            std::unique_lock<std::mutex> lock(mergeMutex_);
+            while (!mergeCv_.wait_for(lock, interval, [this] { return mergeStop_; })) {
+                lock.unlock();
+                mergeUnderfullLeaves();
+                lock.lock();
+            }
+        });
+    }
+
+    void stopBackgroundMerge() {
+        if (!mergeThread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mergeMutex_);
+            mergeStop_ = true;
+        }
+        mergeCv_.notify_all();
+        mergeThread_.join();
+    }
+
+    // ------------------------------------------------
+    // Relayout
+    // ------------------------------------------------
+    // Copies every live node into freshly allocated nodes in the given order and
+    // renumbers child and nextLeaf indices so arena index order matches it. Nodes are
+    // allocated back to back, so the allocator places related nodes close together.
+    // Gets, scans and writes pause for the duration (about one copy of the tree).
+    // Skipped while a snapshot is live, since snapshots hold the old indices. Returns
+    // false if skipped.
+    bool relayout(LayoutOrder order = LayoutOrder::VanEmdeBoas) {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        if (rootIndex_ == SIZE_MAX || maxLiveSnapshot_ != 0) return false;
+        quiesce();
+
+        std::vector<uint64_t> layout;
+        layout.reserve(nodes_.size());
+        if (order == LayoutOrder::BreadthFirst) {
+            layoutBreadthFirst(layout);
+        } else {
+            layoutVanEmdeBoas(rootIndex_, get_tree_depth(rootIndex_), layout);
+        }
+        std::vector<uint64_t> remap(nodes_.size(), SIZE_MAX);
+        for (size_t i = 0; i < layout.size(); i++) remap[layout[i]] = i;
+
+        std::vector<std::unique_ptr<Node>> fresh;
+        fresh.reserve(layout.size());
+        for (uint64_t oldIdx : layout) {
+            const Node *src = nodes_[oldIdx].get();
+            auto dst = std::make_unique<Node>(src->type);
+            dst->version = writeVersion_;
+            if (src->type == NodeType::Internal) {
+                *dst->internal = *src->internal;
+                for (uint32_t c = 0; c <= dst->internal->numKeys; c++) {
+                    dst->internal->childIndices[c] = remap[dst->internal->childIndices[c]];
+                }
+            } else {
+                *dst->leaf = *src->leaf;
+                if (dst->leaf->nextLeaf != SIZE_MAX) dst->leaf->nextLeaf = remap[dst->leaf->nextLeaf];
+            }
+            fresh.push_back(std::move(dst));
+        }
+
+        // No op is in flight and new ones wait in lockRoot(), so the old nodes are freed
+        // as their slots are overwritten
+        for (size_t i = 0; i < fresh.size(); i++) nodes_[i] = std::move(fresh[i]);
+        nodes_.truncate(layout.size());
+        retired_.clear();
+        freeNodes_.clear();
+        rootIndex_ = 0;
+        return true;
+    }
+
+    // Average share of leaf slots in use
+    double leafFillFactor() {
+        std::shared_lock<std::shared_mutex> treeLock(tree_mutex);
+        std::shared_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);  // keeps writers out
+        int leaves = get_total_leaf_nodes(rootIndex_);
+        if (leaves == 0) return 0.0;
+        return static_cast<double>(get_total_leaf_keys(rootIndex_)) / (static_cast<double>(leaves) * MAX_KEYS_LEAF);
+    }
+
     void print_btree(uint64_t nodeOffset, int level) {
         if (nodeOffset == SIZE_MAX) return;  // skip null nodes
 
@@ -197,19 +641,285 @@ public:
         std::cout << "  Total Nodes: " << get_total_nodes(rootIndex_) << "\n";
         std::cout << "  Total internal nodes: " << get_total_internal_nodes(rootIndex_) << "\n";
         std::cout << "  Total leaf nodes: " << get_total_leaf_nodes(rootIndex_) << "\n";
+        std::cout << "  Leaf fill factor: " << leafFillFactor() << "\n";
         std::cout << "  Total Size (in MB): " << (get_total_nodes(rootIndex_) * NODE_SIZE) / (1024.0 * 1024.0) << "\n";
     }
 
-    size_t rootIndex_ = SIZE_MAX;
-    std::vector<std::unique_ptr<Node>> nodes_;
+    std::atomic<size_t> rootIndex_{SIZE_MAX};  // read without tree_mutex by lockRoot()
+    NodeArena nodes_;
     mutable std::shared_mutex tree_mutex; // Optional global lock for the whole tree
 
     // Atomic counters for reads/writes
     std::atomic<int> total_reads{0};
     std::atomic<int> total_writes{0};
-    std::vector<uint64_t> accessed_page_numbers;
+    PageTracer page_trace;  // node visits by get/put/update/upsert/rangeQuery, off until enabled
 
 private:
+    // ------------------------------------------------
+    // Copy-on-write state. Changed under tree_mutex, or by a writer while it holds the
+    // live root exclusively (which keeps every other writer out of the tree).
+    // ------------------------------------------------
+    uint64_t writeVersion_ = 1;                  // version stamped on nodes created by writers
+    std::atomic<uint64_t> maxLiveSnapshot_{0};  // 0 when no snapshot is live
+    std::multiset<uint64_t> liveSnapshots_;
+    std::vector<std::pair<uint64_t, size_t>> retired_;  // (version it was shadowed at, node index)
+    std::vector<size_t> freeNodes_;
+    std::atomic<int> active_ops_{0};            // gets, scans and writes inside the live tree (OpGuard)
+    std::atomic<SplitPolicy> splitPolicy_{SplitPolicy::Adaptive};
+
+    // Background merge thread
+    std::thread mergeThread_;
+    std::mutex mergeMutex_;
+    std::condition_variable mergeCv_;
+    bool mergeStop_ = false;
+
+    // Counts an op from the moment lockRoot() finds the root until it returns. While
+    // any op is counted, retired nodes are not freed and node slots do not move.
+    struct OpGuard {
+        std::atomic<int> &count;
+        bool entered = false;
+        explicit OpGuard(std::atomic<int> &c) : count(c) {}
+        ~OpGuard() { leave(); }
+        void enter() {
+            if (!entered) count.fetch_add(1);
+            entered = true;
+        }
+        void leave() {
+            if (entered) count.fetch_sub(1);
+            entered = false;
+        }
+    };
+
+    // Waits until no op is counted. Caller holds tree_mutex exclusively, so no new op
+    // can enter. Counted ops never wait on tree_mutex: lockRoot() uncounts an op before
+    // it retries, and writers leave their OpGuard before writeReplacingRoot().
+    void quiesce() const {
+        while (active_ops_.load() != 0) std::this_thread::yield();
+    }
+
+    void releaseSnapshot(uint64_t version) {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        liveSnapshots_.erase(liveSnapshots_.find(version));
+        maxLiveSnapshot_ = liveSnapshots_.empty() ? 0 : *liveSnapshots_.rbegin();
+        reclaimRetired();
+    }
+
+    // Frees shadowed nodes that no live snapshot can reach. Caller holds tree_mutex
+    // exclusively and no node lock; ops in flight may still hold a retired node, so
+    // they are waited out first.
+    void reclaimRetired() {
+        quiesce();
+        uint64_t oldestLive = liveSnapshots_.empty() ? UINT64_MAX : *liveSnapshots_.begin();
+        size_t kept = 0;
+        for (auto &r : retired_) {
+            if (r.first <= oldestLive) {
+                nodes_[r.second].reset();
+                freeNodes_.push_back(r.second);
+            } else {
+                retired_[kept++] = r;
+            }
+        }
+        retired_.resize(kept);
+    }
+
+    void layoutBreadthFirst(std::vector<uint64_t> &layout) const {
+        layout.push_back(rootIndex_);
+        for (size_t head = 0; head < layout.size(); head++) {
+            const Node *node = nodes_[layout[head]].get();
+            if (node->type == NodeType::Leaf) continue;
+            for (uint32_t c = 0; c <= node->internal->numKeys; c++) layout.push_back(node->internal->childIndices[c]);
+        }
+    }
+
+    // Lays out the top half of the levels below nodeOffset recursively, then each
+    // subtree hanging off it. The tree is balanced, so height is the same on every path.
+    void layoutVanEmdeBoas(uint64_t nodeOffset, int height, std::vector<uint64_t> &layout) const {
+        if (height <= 1) {
+            layout.push_back(nodeOffset);
+            return;
+        }
+        int top = height / 2;
+        layoutVanEmdeBoas(nodeOffset, top, layout);
+        std::vector<uint64_t> bottomRoots;
+        collectAtDepth(nodeOffset, top, bottomRoots);
+        for (uint64_t child : bottomRoots) layoutVanEmdeBoas(child, height - top, layout);
+    }
+
+    void collectAtDepth(uint64_t nodeOffset, int depth, std::vector<uint64_t> &out) const {
+        if (depth == 0) {
+            out.push_back(nodeOffset);
+            return;
+        }
+        const InternalNode *internal = nodes_[nodeOffset]->internal.get();
+        for (uint32_t c = 0; c <= internal->numKeys; c++) collectAtDepth(internal->childIndices[c], depth - 1, out);
+    }
+
+    // Caller holds tree_mutex, so the internal levels only change here; parents and
+    // leaves are locked exclusively before they are modified.
+    size_t mergeLeavesBelow(uint64_t nodeOffset) {
+        InternalNode *internal = nodes_[nodeOffset]->internal.get();
+        if (nodes_[internal->childIndices[0]]->type == NodeType::Internal) {
+            size_t merged = 0;
+            for (uint32_t i = 0; i <= internal->numKeys; i++) merged += mergeLeavesBelow(internal->childIndices[i]);
+            return merged;
+        }
+        const uint32_t underfull = static_cast<uint32_t>(MAX_KEYS_LEAF * LEAF_MERGE_FILL_THRESHOLD);
+        size_t merged = 0;
+        std::unique_lock<std::shared_mutex> parentLock(nodes_[nodeOffset]->node_mutex);
+        uint32_t i = 0;
+        while (i < internal->numKeys) {
+            uint64_t leftOff = internal->childIndices[i];
+            uint64_t rightOff = internal->childIndices[i + 1];
+            std::unique_lock<std::shared_mutex> leftLock(nodes_[leftOff]->node_mutex);
+            std::unique_lock<std::shared_mutex> rightLock(nodes_[rightOff]->node_mutex);
+            LeafNode *left = nodes_[leftOff]->leaf.get();
+            LeafNode *right = nodes_[rightOff]->leaf.get();
+            if (left->numKeys + right->numKeys > (uint32_t)MAX_KEYS_LEAF ||
+                (left->numKeys >= underfull && right->numKeys >= underfull)) {
+                i++;
+                continue;
+            }
+            // The right leaf is left intact for scans already positioned on it
+            for (uint32_t k = 0; k < right->numKeys; k++) {
+                left->keys[left->numKeys + k] = right->keys[k];
+                left->values[left->numKeys + k] = right->values[k];
+            }
+            left->numKeys += right->numKeys;
+            left->nextLeaf = right->nextLeaf;
+            left->lastInsertPos = -1;
+            for (uint32_t k = i; k + 1 < internal->numKeys; k++) {
+                internal->keys[k] = internal->keys[k + 1];
+                internal->childIndices[k + 1] = internal->childIndices[k + 2];
+            }
+            internal->numKeys--;
+            retired_.emplace_back(writeVersion_, rightOff);
+            merged++;
+        }
+        return merged;
+    }
+
+    // ------------------------------------------------
+    // Checkpoint helpers
+    // ------------------------------------------------
+    static char *allocAligned(size_t bytes) {
+        void *p = nullptr;
+        if (posix_memalign(&p, NODE_SIZE, bytes) != 0) throw std::bad_alloc();
+        return static_cast<char *>(p);
+    }
+
+    // Prefers O_DIRECT; falls back to buffered I/O on filesystems without it (tmpfs).
+    static int openCheckpointFile(const std::string &path, int flags) {
+        int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) fd = open(path.c_str(), flags, 0644);
+        if (fd < 0) throw std::runtime_error("cannot open checkpoint file " + path + ": " + std::strerror(errno));
+        return fd;
+    }
+
+    template <typename Fn>
+    static void runParallel(unsigned numThreads, Fn fn) {
+        if (numThreads == 0) numThreads = 1;
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < numThreads; t++) threads.emplace_back(fn);
+        fn();
+        for (auto &t : threads) t.join();
+    }
+
+    bool encodeNode(size_t index, char *slot) const {
+        const Node *node = nodes_[index].get();
+        if (!node) {
+            slot[0] = NODE_TYPE_FREE;
+            return true;
+        }
+        if (node->type == NodeType::Internal) {
+            InternalNodeDisk *disk = reinterpret_cast<InternalNodeDisk *>(slot);
+            const InternalNode *internal = node->internal.get();
+            disk->nodeType = NODE_TYPE_INTERNAL;
+            disk->numKeys = internal->numKeys;
+            for (uint32_t i = 0; i < internal->numKeys; i++) disk->keys[i] = internal->keys[i];
+            for (uint32_t i = 0; i <= internal->numKeys; i++) disk->childPtrs[i] = internal->childIndices[i];
+            return true;
+        }
+        LeafNodeDisk *disk = reinterpret_cast<LeafNodeDisk *>(slot);
+        const LeafNode *leaf = node->leaf.get();
+        disk->nodeType = NODE_TYPE_LEAF;
+        disk->numKeys = leaf->numKeys;
+        disk->nextLeaf = leaf->nextLeaf;
+        for (uint32_t i = 0; i < leaf->numKeys; i++) {
+            if (leaf->values[i].size() > sizeof(disk->records[i].value)) return false;
+            disk->records[i].valueLen = leaf->values[i].size();
+            disk->records[i].key = leaf->keys[i];
+            std::memcpy(disk->records[i].value, leaf->values[i].data(), leaf->values[i].size());
+        }
+        return true;
+    }
+
+    // Returns false if the slot is not a valid node of a numNodes-slot checkpoint: an
+    // unknown type, more keys than fit, or a link past the last slot.
+    bool decodeNode(const char *slot, size_t numNodes, std::unique_ptr<Node> &out) const {
+        uint8_t nodeType = static_cast<uint8_t>(slot[0]);
+        if (nodeType == NODE_TYPE_FREE) return true;
+        if (nodeType == NODE_TYPE_INTERNAL) {
+            const InternalNodeDisk *disk = reinterpret_cast<const InternalNodeDisk *>(slot);
+            uint32_t numKeys = disk->numKeys;
+            if (numKeys > (uint32_t)MAX_KEYS_INTERNAL) return false;
+            auto node = std::make_unique<Node>(NodeType::Internal);
+            InternalNode *internal = node->internal.get();
+            internal->numKeys = numKeys;
+            for (uint32_t i = 0; i < numKeys; i++) internal->keys[i] = disk->keys[i];
+            for (uint32_t i = 0; i <= numKeys; i++) {
+                if (disk->childPtrs[i] >= numNodes) return false;
+                internal->childIndices[i] = disk->childPtrs[i];
+            }
+            node->version = writeVersion_;
+            out = std::move(node);
+            return true;
+        }
+        if (nodeType != NODE_TYPE_LEAF) return false;
+        const LeafNodeDisk *disk = reinterpret_cast<const LeafNodeDisk *>(slot);
+        uint32_t numKeys = disk->numKeys;
+        uint64_t nextLeaf = disk->nextLeaf;
+        if (numKeys > (uint32_t)MAX_KEYS_LEAF || (nextLeaf != SIZE_MAX && nextLeaf >= numNodes)) return false;
+        auto node = std::make_unique<Node>(NodeType::Leaf);
+        LeafNode *leaf = node->leaf.get();
+        leaf->numKeys = numKeys;
+        leaf->nextLeaf = nextLeaf;
+        for (uint32_t i = 0; i < numKeys; i++) {
+            const LeafRecord &rec = disk->records[i];
+            if (rec.valueLen > sizeof(rec.value)) return false;
+            leaf->keys[i] = rec.key;
+            leaf->values[i].assign(rec.value, rec.valueLen);
+        }
+        node->version = writeVersion_;
+        out = std::move(node);
+        return true;
+    }
+
+    bool needsShadow(uint64_t nodeOffset) const { return nodes_[nodeOffset]->version <= maxLiveSnapshot_.load(); }
+
+    // Copies a node a snapshot can see; the original is retired at the current version.
+    uint64_t shadowNode(uint64_t nodeOffset) {
+        Node *src = nodes_[nodeOffset].get();
+        uint64_t copy = src->type == NodeType::Leaf ? allocateLeaf() : allocateNode();
+        Node *dst = nodes_[copy].get();
+        if (src->type == NodeType::Leaf) {
+            *dst->leaf = *src->leaf;
+        } else {
+            *dst->internal = *src->internal;
+        }
+        retired_.emplace_back(writeVersion_, nodeOffset);
+        return copy;
+    }
+
+    // Points the rightmost leaf of subtree at a freshly shadowed leaf.
+    void relinkPredecessor(uint64_t subtree, uint64_t newLeaf) {
+        uint64_t cur = subtree;
+        while (nodes_[cur]->type == NodeType::Internal) {
+            cur = nodes_[cur]->internal->childIndices[nodes_[cur]->internal->numKeys];
+        }
+        std::unique_lock<std::shared_mutex> leafLock(nodes_[cur]->node_mutex);
+        nodes_[cur]->leaf->nextLeaf = newLeaf;
+    }
+
     // ------------------------------------------------
     // Stats helpers
     // ------------------------------------------------
@@ -258,6 +968,16 @@ private:
             return total;
         }
     }
+    size_t get_total_leaf_keys(uint64_t nodeOffset) {
+        if (nodeOffset == SIZE_MAX) return 0;
+        if (nodes_[nodeOffset]->type == NodeType::Leaf) return nodes_[nodeOffset]->leaf->numKeys;
+        InternalNode *internal = nodes_[nodeOffset]->internal.get();
+        size_t total = 0;
+        for (uint32_t i = 0; i <= internal->numKeys; i++) {
+            total += get_total_leaf_keys(internal->childIndices[i]);
+        }
+        return total;
+    }
     int get_total_leaf_nodes(uint64_t nodeOffset) {
         if (nodeOffset == SIZE_MAX) return 0;
         uint8_t nodeType = nodes_[nodeOffset]->type == NodeType::Internal ? NODE_TYPE_INTERNAL : NODE_TYPE_LEAF;
@@ -275,24 +995,59 @@ private:
     // ------------------------------------------------
     // Low-level I/O
     // ------------------------------------------------
-    uint64_t allocateNode() {
-        uint64_t newOffset = nodes_.size();
-        nodes_.emplace_back(std::make_unique<Node>(NodeType::Internal));
-        return newOffset;
-    }
+    uint64_t allocateNode() { return allocate(NodeType::Internal); }
 
-    uint64_t allocateLeaf() {
-        uint64_t newOffset = nodes_.size();
-        nodes_.emplace_back(std::make_unique<Node>(NodeType::Leaf));
+    uint64_t allocateLeaf() { return allocate(NodeType::Leaf); }
+
+    uint64_t allocate(NodeType type) {
+        uint64_t newOffset;
+        if (!freeNodes_.empty()) {
+            newOffset = freeNodes_.back();
+            freeNodes_.pop_back();
+            nodes_[newOffset] = std::make_unique<Node>(type);
+        } else {
+            newOffset = nodes_.size();
+            nodes_.emplace_back(std::make_unique<Node>(type));
+        }
+        nodes_[newOffset]->version = writeVersion_;
         return newOffset;
     }
 
     // ------------------------------------------------
     // Search
     // ------------------------------------------------
-    bool searchKey(uint64_t nodeOffset, uint64_t key, std::string &outValue) {
+    // Locks the current root (shared or exclusive) and counts op. The root's slot is
+    // read and op entered under a shared tree_mutex, so relayout() and restore() either
+    // see op or run before it reads the slot. Retries if the root was replaced (split,
+    // shadowed or collapsed) between reading rootIndex_ and acquiring its lock; the op
+    // stays counted until the stale root is unlocked, which keeps it allocated, and is
+    // uncounted while it waits for tree_mutex again.
+    template <typename RootLock>
+    bool lockRoot(uint64_t &root, RootLock &rootLock, OpGuard &op) {
+        while (true) {
+            Node *rootNode;
+            {
+                std::shared_lock<std::shared_mutex> treeLock(tree_mutex);
+                root = rootIndex_;
+                if (root == SIZE_MAX) return false;
+                op.enter();
+                rootNode = nodes_[root].get();
+            }
+            RootLock lock(rootNode->node_mutex);
+            if (root == rootIndex_) {
+                rootLock = std::move(lock);
+                return true;
+            }
+            lock.unlock();
+            op.leave();
+        }
+    }
+
+    // nodeLock holds nodeOffset shared; ancestors stay locked until the lookup returns.
+    bool searchKey(uint64_t nodeOffset, [[maybe_unused]] std::shared_lock<std::shared_mutex> nodeLock,
+                   uint64_t key, std::string &outValue, int level = 0) {
         if (nodeOffset == SIZE_MAX) return false;
-        std::shared_lock<std::shared_mutex> nodeLock(nodes_[nodeOffset]->node_mutex);
+        PAGE_TRACE(page_trace, nodeOffset, level, TraceOp::Get);
         uint8_t nodeType = nodes_[nodeOffset]->type == NodeType::Internal ? NODE_TYPE_INTERNAL : NODE_TYPE_LEAF;
         if (nodeType == NODE_TYPE_LEAF) {
             LeafNode *leaf = nodes_[nodeOffset]->leaf.get();
@@ -309,56 +1064,138 @@ private:
             while (i < (int)internal->numKeys && key >= internal->keys[i]) {
                 i++;
             }
-            return searchKey(internal->childIndices[i], key, outValue);
+            uint64_t child = internal->childIndices[i];
+            std::shared_lock<std::shared_mutex> childLock(nodes_[child]->node_mutex);
+            return searchKey(child, std::move(childLock), key, outValue, level + 1);
         }
     }
-    uint64_t findLeafForKey(uint64_t nodeOffset, uint64_t key) {
+    uint64_t findLeafForKey(uint64_t nodeOffset, [[maybe_unused]] std::shared_lock<std::shared_mutex> nodeLock,
+                            uint64_t key, int level = 0, int *leafLevel = nullptr) {
         if (nodeOffset == SIZE_MAX) return SIZE_MAX;
-        std::shared_lock<std::shared_mutex> nodeLock(nodes_[nodeOffset]->node_mutex);
         uint8_t nodeType = nodes_[nodeOffset]->type == NodeType::Internal ? NODE_TYPE_INTERNAL : NODE_TYPE_LEAF;
         if (nodeType == NODE_TYPE_LEAF) {
-            return nodeOffset;
+            if (leafLevel) *leafLevel = level;
+            return nodeOffset;  // the scan loop records the leaf visit
         }
+        PAGE_TRACE(page_trace, nodeOffset, level, TraceOp::Scan);
         InternalNode *internal = nodes_[nodeOffset]->internal.get();
         int i = 0;
         while (i < static_cast<int>(internal->numKeys) && key >= internal->keys[i]) ++i;
-        return findLeafForKey(internal->childIndices[i], key);
+        uint64_t child = internal->childIndices[i];
+        std::shared_lock<std::shared_mutex> childLock(nodes_[child]->node_mutex);
+        return findLeafForKey(child, std::move(childLock), key, level + 1, leafLevel);
+    }
+
+    // ------------------------------------------------
+    // Write path shared by put / update / upsert
+    // ------------------------------------------------
+    // Writers lock the root exclusively for the whole insert, so they are serialized at
+    // the root and lock nodes top-down below it. tree_mutex is only taken when the root
+    // itself changes, so that it does so atomically with respect to snapshot().
+    void write(uint64_t key, const std::string &value, WriteOp *op) {
+        if (!writeBelowRoot(key, value, op)) writeReplacingRoot(key, value, op);
+    }
+
+    // Inserts under the root lock alone. Returns false, having changed nothing, if the
+    // tree is empty or the write could split or shadow the root.
+    bool writeBelowRoot(uint64_t key, const std::string &value, WriteOp *op) {
+        OpGuard guard(active_ops_);
+        uint64_t root;
+        std::unique_lock<std::shared_mutex> rootLock;
+        if (!lockRoot(root, rootLock, guard) || mayReplaceRoot(root, key)) return false;
+        insertInternal(root, key, value, op);
+        return true;
+    }
+
+    // The root is shadowed while a snapshot can see it, and split only if every node on
+    // the key's path is full. Caller holds the root exclusively, so no writer is below it.
+    bool mayReplaceRoot(uint64_t root, uint64_t key) const {
+        if (needsShadow(root)) return true;
+        uint64_t cur = root;
+        while (nodes_[cur]->type == NodeType::Internal) {
+            const InternalNode *internal = nodes_[cur]->internal.get();
+            if (internal->numKeys < (uint32_t)MAX_KEYS_INTERNAL) return false;
+            uint32_t i = 0;
+            while (i < internal->numKeys && key >= internal->keys[i]) i++;
+            cur = internal->childIndices[i];
+        }
+        return nodes_[cur]->leaf->numKeys >= (uint32_t)MAX_KEYS_LEAF;
+    }
+
+    // Holds tree_mutex, which keeps reclaim, relayout and restore out in place of an
+    // OpGuard, and publishes the new root before the old one is unlocked. A new root
+    // is private until then, so it is filled in without its lock.
+    void writeReplacingRoot(uint64_t key, const std::string &value, WriteOp *op) {
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        if (rootIndex_ == SIZE_MAX) {
+            if (op && !op->insertIfMissing) return;
+            uint64_t newRoot = allocateLeaf();
+            nodes_[newRoot]->leaf->keys[0] = key;
+            nodes_[newRoot]->leaf->values[0] = value;
+            nodes_[newRoot]->leaf->numKeys = 1;
+            rootIndex_ = newRoot;
+            if (op) op->applied = true;
+            return;
+        }
+        std::unique_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);
+        InsertResult result = insertInternal(rootIndex_, key, value, op);
+        if (result.replacedOffset != SIZE_MAX) {
+            rootIndex_ = result.replacedOffset;
+        }
+        if (result.splitted) {
+            uint64_t newRoot = allocateNode();
+            nodes_[newRoot]->internal->keys[0] = result.promotedKey;
+            nodes_[newRoot]->internal->childIndices[0] = rootIndex_;
+            nodes_[newRoot]->internal->childIndices[1] = result.newChildOffset;
+            nodes_[newRoot]->internal->numKeys = 1;
+            rootIndex_ = newRoot;
+        }
     }
 
     // ------------------------------------------------
     // Insert Internal
     // ------------------------------------------------
-    InsertResult insertInternal(uint64_t nodeOffset, uint64_t key, const std::string &val) {
-        if (nodeOffset == SIZE_MAX) {
-            std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
-            rootIndex_ = allocateLeaf();
-            std::unique_lock<std::shared_mutex> rootLock(nodes_[rootIndex_]->node_mutex);
-            nodes_[rootIndex_]->leaf->keys[0] = key;
-            nodes_[rootIndex_]->leaf->values[0] = val;
-            nodes_[rootIndex_]->leaf->numKeys = 1;
-            return {false, 0, 0};
-        }
-        std::unique_lock<std::shared_mutex> nodeLock(nodes_[nodeOffset]->node_mutex);
-        uint8_t nodeType = nodes_[nodeOffset]->type == NodeType::Internal ? NODE_TYPE_INTERNAL : NODE_TYPE_LEAF;
+    // Caller holds nodeOffset exclusively.
+    InsertResult insertInternal(uint64_t nodeOffset, uint64_t key, const std::string &val, WriteOp *op,
+                                int level = 0) {
+        PAGE_TRACE(page_trace, nodeOffset, level, op ? TraceOp::Update : TraceOp::Put);
+        // A node a snapshot can see is copied and the copy is updated instead; the
+        // copy is private until the (already locked) parent links it in.
+        uint64_t target = needsShadow(nodeOffset) ? shadowNode(nodeOffset) : nodeOffset;
+        uint8_t nodeType = nodes_[target]->type == NodeType::Internal ? NODE_TYPE_INTERNAL : NODE_TYPE_LEAF;
+        InsertResult res;
         if (nodeType == NODE_TYPE_LEAF) {
-            return insertLeaf(nodeOffset, nodes_[nodeOffset]->leaf.get(), key, val);
+            res = insertLeaf(target, nodes_[target]->leaf.get(), key, val, op);
         } else {
-            return insertIntoInternal(nodeOffset, nodes_[nodeOffset]->internal.get(), key, val);
+            res = insertIntoInternal(target, nodes_[target]->internal.get(), key, val, op, level);
+        }
+        if (target != nodeOffset) {
+            res.replacedOffset = target;
+            if (nodeType == NODE_TYPE_LEAF) res.relinkLeaf = target;
         }
+        return res;
     }
 
     // ------------------------------------------------
     // Insert into a Leaf
     // ------------------------------------------------
-    InsertResult insertLeaf(uint64_t leafOffset, LeafNode *leaf, uint64_t key, const std::string &val) {
+    InsertResult insertLeaf(uint64_t leafOffset, LeafNode *leaf, uint64_t key, const std::string &val,
+                            WriteOp *op) {
         InsertResult res{};
         res.splitted = false;
         for (uint32_t i = 0; i < leaf->numKeys; i++) {
             if (leaf->keys[i] == key) {
-                leaf->values[i] = val;
+                if (op && op->updater) {
+                    (*op->updater)(leaf->values[i]);
+                } else {
+                    leaf->values[i] = val;
+                }
+                if (op) op->applied = true;
                 return res;  // no split
             }
         }
+        if (op && !op->insertIfMissing) return res;
+        if (op) op->applied = true;
         if (leaf->numKeys < MAX_KEYS_LEAF) {
             int pos = leaf->numKeys;
             while (pos > 0 && leaf->keys[pos - 1] > key) {
@@ -369,12 +1206,24 @@ private:
             leaf->keys[pos] = key;
             leaf->values[pos] = val;
             leaf->numKeys++;
+            leaf->lastInsertPos = pos;
             return res;
         } else {
             return splitLeaf(leafOffset, leaf, key, val);
         }
     }
 
+    // Index of the first key that moves right (leaf) or is promoted (internal).
+    size_t chooseSplitIndex(size_t totalKeys, int bias, size_t lo, size_t hi) const {
+        size_t idx = totalKeys / 2;
+        if (splitPolicy_ == SplitPolicy::Adaptive && bias > 0) {
+            idx = static_cast<size_t>(totalKeys * SPLIT_APPEND_FRACTION);
+        } else if (splitPolicy_ == SplitPolicy::Adaptive && bias < 0) {
+            idx = totalKeys - static_cast<size_t>(totalKeys * SPLIT_APPEND_FRACTION);
+        }
+        return std::min(std::max(idx, lo), hi);
+    }
+
     InsertResult splitLeaf(uint64_t leafOffset, LeafNode *leaf, uint64_t key, const std::string &val) {
         // Gather all keys/values including the new one
         std::vector<uint64_t> tmpKeys(leaf->numKeys);
@@ -397,7 +1246,11 @@ private:
         uint64_t newLeafOffset = allocateLeaf();
         std::unique_lock<std::shared_mutex> newLeafLock(nodes_[newLeafOffset]->node_mutex);
         LeafNode* newLeaf = nodes_[newLeafOffset]->leaf.get();
-        size_t split = tmpKeys.size() / 2;
+        // Two inserts in a row at the end (start) of this leaf mark an append (prepend) run
+        int bias = 0;
+        if (pos == leaf->numKeys && leaf->lastInsertPos == (int32_t)leaf->numKeys - 1) bias = 1;
+        else if (pos == 0 && leaf->lastInsertPos == 0) bias = -1;
+        size_t split = chooseSplitIndex(tmpKeys.size(), bias, 1, tmpKeys.size() - 1);
         // Assign first half to original leaf
         leaf->numKeys = split;
         for (size_t i = 0; i < split; i++) {
@@ -412,10 +1265,17 @@ private:
         }
         newLeaf->nextLeaf = leaf->nextLeaf;
         leaf->nextLeaf = newLeafOffset;
+        if (pos < split) {
+            leaf->lastInsertPos = pos;
+        } else {
+            leaf->lastInsertPos = -1;
+            newLeaf->lastInsertPos = pos - split;
+        }
         InsertResult res;
         res.splitted = true;
         res.newChildOffset = newLeafOffset;
         res.promotedKey = newLeaf->keys[0]; // promote the first key of the new leaf
+        res.splitBias = bias;
         return res;
     }
 
@@ -423,14 +1283,26 @@ private:
     // Insert into an Internal node
     // ------------------------------------------------
     InsertResult insertIntoInternal(uint64_t nodeOffset, InternalNode *internal, uint64_t key,
-                                    const std::string &val) {
+                                    const std::string &val, WriteOp *op, int level) {
         InsertResult res{};
         res.splitted = false;
         int i = 0;
         while (i < (int)internal->numKeys && key >= internal->keys[i]) {
             i++;
         }
-        InsertResult cRes = insertInternal(internal->childIndices[i], key, val);
+        InsertResult cRes;
+        {
+            std::unique_lock<std::shared_mutex> childLock(nodes_[internal->childIndices[i]]->node_mutex);
+            cRes = insertInternal(internal->childIndices[i], key, val, op, level + 1);
+        }
+        if (cRes.replacedOffset != SIZE_MAX) {
+            internal->childIndices[i] = cRes.replacedOffset;
+        }
+        if (cRes.relinkLeaf != SIZE_MAX && i > 0) {
+            relinkPredecessor(internal->childIndices[i - 1], cRes.relinkLeaf);
+            cRes.relinkLeaf = SIZE_MAX;
+        }
+        res.relinkLeaf = cRes.relinkLeaf;  // predecessor lives left of this subtree
         if (!cRes.splitted) {
             return res;
         }
@@ -444,7 +1316,9 @@ private:
             internal->numKeys++;
             return res;
         } else {
-            return splitInternal(nodeOffset, internal, i, cRes);
+            InsertResult splitRes = splitInternal(nodeOffset, internal, i, cRes);
+            splitRes.relinkLeaf = res.relinkLeaf;
+            return splitRes;
         }
     }
 
@@ -462,7 +1336,11 @@ private:
         tmpChildIndices.insert(tmpChildIndices.begin() + (childIndex + 1), cRes.newChildOffset);
         // Now tmpKeys.size() == MAX_KEYS_INTERNAL + 1
         size_t totalKeys = tmpKeys.size();
-        size_t midIndex = totalKeys / 2;
+        // A child split by a run at this node's right (left) edge continues the run here
+        int bias = 0;
+        if (cRes.splitBias > 0 && childIndex == (int)node->numKeys) bias = 1;
+        else if (cRes.splitBias < 0 && childIndex == 0) bias = -1;
+        size_t midIndex = chooseSplitIndex(totalKeys, bias, 1, totalKeys - 2);
         uint64_t promotedKey = tmpKeys[midIndex];
         size_t leftCount = midIndex;
         size_t rightCount = totalKeys - (leftCount + 1);
@@ -487,6 +1365,9 @@ private:
         res.splitted = true;
         res.promotedKey = promotedKey;
         res.newChildOffset = newOffset;
+        res.splitBias = bias;
         return res;
     }
-};
\ No newline at end of file
+};
+
+#endif  // BTREE_H
@@ -0,0 +1,127 @@
+// Stress test for BPlusTree's concurrency. Writers grow the tree from empty, so the root
+// splits during the load and is shadowed again after every snapshot, while readers
+// look keys up and scan, and background threads take and release snapshots, merge
+// underfull leaves and relay the tree out. Exits non-zero on a wrong result, or if no
+// operation completes for STALL_SECONDS (a deadlock).
+#include "btree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+
+static const size_t KEYS = 400000;
+static const int WRITERS = 2;
+static const int READERS = 2;
+static const int STALL_SECONDS = 10;
+
+static std::atomic<uint64_t> progress{0};
+
+static void check(bool ok, const char* what, uint64_t key) {
+    if (ok) return;
+    std::fprintf(stderr, "btree_stress: %s (key %lu)\n", what, (unsigned long)key);
+    std::exit(1);
+}
+
+static std::string value_for(uint64_t key) { return std::to_string(key % 100000000); }
+
+int main() {
+    BPlusTree tree;
+    // Writer w inserts the keys congruent to w, in random order, and publishes how many
+    // of them are in so readers only look for keys that must be found.
+    std::vector<std::vector<uint64_t>> order(WRITERS);
+    std::vector<std::atomic<size_t>> inserted(WRITERS);
+    std::mt19937_64 rng(42);
+    for (int w = 0; w < WRITERS; w++) {
+        for (uint64_t k = w; k < KEYS; k += WRITERS) order[w].push_back(k);
+        std::shuffle(order[w].begin(), order[w].end(), rng);
+        inserted[w] = 0;
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers, others;
+    for (int w = 0; w < WRITERS; w++) {
+        writers.emplace_back([&, w] {
+            for (uint64_t key : order[w]) {
+                tree.put(key, value_for(key));
+                inserted[w].fetch_add(1);
+                progress.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (int r = 0; r < READERS; r++) {
+        others.emplace_back([&, r] {
+            std::mt19937_64 pick(r);
+            std::string value;
+            while (!stop) {
+                int w = pick() % WRITERS;
+                size_t done = inserted[w].load();
+                if (done == 0) continue;
+                uint64_t key = order[w][pick() % done];
+                check(tree.get(key, value) && value == value_for(key), "get missed an inserted key", key);
+                progress.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    others.emplace_back([&] {
+        while (!stop) {
+            auto out = tree.rangeQuery(1000, 2000);
+            for (size_t i = 1; i < out.size(); i++) check(out[i - 1].first < out[i].first, "scan out of order", out[i].first);
+            progress.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    // Each snapshot must read the same thing twice, and every key inserted before it
+    others.emplace_back([&] {
+        while (!stop) {
+            size_t done = inserted[0].load();
+            auto snap = tree.snapshot();
+            size_t first = snap.rangeQuery(0, UINT64_MAX, SIZE_MAX).size();
+            std::string value;
+            for (size_t i = 0; i < done; i += 97) check(snap.get(order[0][i], value), "snapshot lost a key", order[0][i]);
+            check(snap.rangeQuery(0, UINT64_MAX, SIZE_MAX).size() == first, "snapshot changed", first);
+            progress.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    others.emplace_back([&] {
+        while (!stop) {
+            tree.relayout();
+            progress.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+    tree.startBackgroundMerge(std::chrono::milliseconds(1));
+
+    // Watchdog
+    std::thread watchdog([&] {
+        uint64_t last = progress.load();
+        int idle = 0;
+        while (!stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            uint64_t now = progress.load();
+            idle = now == last ? idle + 1 : 0;
+            last = now;
+            if (idle >= STALL_SECONDS * 10) {
+                std::fprintf(stderr, "btree_stress: no progress for %d s, deadlocked\n", STALL_SECONDS);
+                std::_Exit(2);
+            }
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& t : writers) t.join();
+    stop = true;
+    for (auto& t : others) t.join();
+    watchdog.join();
+    tree.stopBackgroundMerge();
+
+    std::string value;
+    for (uint64_t key = 0; key < KEYS; key++) {
+        check(tree.get(key, value) && value == value_for(key), "key missing after the run", key);
+    }
+    check(tree.rangeQuery(0, UINT64_MAX, SIZE_MAX).size() == KEYS, "scan size after the run", KEYS);
+    std::printf("btree_stress: %zu keys, %lu ops in %.1f s, leaf fill factor %.3f\n", KEYS,
+                (unsigned long)progress.load(),
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                tree.leafFillFactor());
+    return 0;
+}
@@ -0,0 +1,671 @@
+#ifndef BWTREE_H
+#define BWTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Bw-TREE CONSTANTS
+// -----------------------------------------------------------------------------
+// Node capacities match BPlusTree (MAX_KEYS_LEAF / MAX_KEYS_INTERNAL) so the two
+// engines are compared at the same fan-out.
+static const size_t BW_MAX_LEAF_RECORDS = 30;
+static const size_t BW_MAX_INNER_KEYS = 120;
+static const uint32_t BW_LEAF_CONSOLIDATE_THRESHOLD = 8;   // delta chain length that triggers consolidation
+static const uint32_t BW_INNER_CONSOLIDATE_THRESHOLD = 4;
+static const size_t BW_DEFAULT_MAPPING_CAPACITY = 1ull << 22;  // 4M PIDs (32 MB of mapping table)
+static const int BW_MAX_THREADS = 256;
+static const size_t BW_RECLAIM_BATCH = 64;  // retired chains per thread before trying to free
+
+using PID = uint64_t;
+static const PID BW_INVALID_PID = std::numeric_limits<PID>::max();
+
+using BwValueUpdater = std::function<void(std::string&)>;
+
+// -----------------------------------------------------------------------------
+// Delta records and base pages
+// -----------------------------------------------------------------------------
+// Every page state is a singly linked chain: newest delta first, base page last.
+// Each record caches the page's key range (high key + right sibling) so readers
+// can decide to move right without walking the whole chain.
+enum class BwNodeType : uint8_t { LeafBase, LeafInsert, LeafDelete, InnerBase, IndexEntry, Split };
+
+struct BwNode {
+    BwNodeType type;
+    bool is_leaf;
+    bool has_high;       // false => page range extends to +inf
+    uint32_t chain_len;  // number of deltas above the base page
+    uint64_t high_key;   // exclusive upper bound of the page range
+    PID sibling;         // right sibling, BW_INVALID_PID if none
+    BwNode* next;        // older state, nullptr for base pages
+
+    BwNode(BwNodeType t, bool leaf, BwNode* n)
+        : type(t), is_leaf(leaf), has_high(false), chain_len(0), high_key(0), sibling(BW_INVALID_PID), next(n) {
+        if (n) {
+            has_high = n->has_high;
+            high_key = n->high_key;
+            sibling = n->sibling;
+            chain_len = n->chain_len + 1;
+        }
+    }
+    virtual ~BwNode() = default;
+
+    bool covers(uint64_t key) const { return !has_high || key < high_key; }
+};
+
+struct BwLeafBase : BwNode {
+    std::vector<uint64_t> keys;
+    std::vector<std::string> values;
+    BwLeafBase() : BwNode(BwNodeType::LeafBase, true, nullptr) {}
+};
+
+// Insert delta; a put on an existing key is the same record (newest wins).
+struct BwLeafInsert : BwNode {
+    uint64_t key;
+    std::string value;
+    BwLeafInsert(uint64_t k, const std::string& v, BwNode* n) : BwNode(BwNodeType::LeafInsert, true, n), key(k), value(v) {}
+};
+
+struct BwLeafDelete : BwNode {
+    uint64_t key;
+    BwLeafDelete(uint64_t k, BwNode* n) : BwNode(BwNodeType::LeafDelete, true, n), key(k) {}
+};
+
+struct BwInnerBase : BwNode {
+    std::vector<uint64_t> keys;   // child i covers [keys[i-1], keys[i])
+    std::vector<PID> children;    // keys.size() + 1 entries
+    BwInnerBase() : BwNode(BwNodeType::InnerBase, false, nullptr) {}
+};
+
+// Parent-side half of a split: keys in [separator, next_key) now live in child.
+struct BwIndexEntry : BwNode {
+    uint64_t separator;
+    bool has_next;
+    uint64_t next_key;
+    PID child;
+    BwIndexEntry(uint64_t sep, bool has_nk, uint64_t nk, PID c, BwNode* n)
+        : BwNode(BwNodeType::IndexEntry, false, n), separator(sep), has_next(has_nk), next_key(nk), child(c) {}
+    bool routes(uint64_t key) const { return key >= separator && (!has_next || key < next_key); }
+};
+
+// Child-side half of a split: keys >= separator moved to the new right sibling.
+struct BwSplit : BwNode {
+    uint64_t separator;
+    PID new_sibling;
+    BwSplit(uint64_t sep, PID sib, BwNode* n) : BwNode(BwNodeType::Split, n->is_leaf, n), separator(sep), new_sibling(sib) {
+        has_high = true;
+        high_key = sep;
+        sibling = sib;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Epoch-based reclamation for unlinked delta chains
+// -----------------------------------------------------------------------------
+class BwEpochManager {
+public:
+    BwEpochManager() : global_epoch_(1) {}
+
+    ~BwEpochManager() {
+        for (auto& slot : slots_) {
+            for (auto& g : slot.garbage) free_chain(g.first);
+            slot.garbage.clear();
+        }
+    }
+
+    void enter() { slots_[thread_slot()].epoch.store(global_epoch_.load()); }
+    void exit() { slots_[thread_slot()].epoch.store(kIdle); }
+
+    // Caller must be inside enter()/exit(); the chain must already be unreachable.
+    void retire(BwNode* chain) {
+        Slot& slot = slots_[thread_slot()];
+        slot.garbage.emplace_back(chain, global_epoch_.load());
+        if (slot.garbage.size() >= BW_RECLAIM_BATCH) reclaim(slot);
+    }
+
+    static void free_chain(BwNode* n) {
+        while (n) {
+            BwNode* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+private:
+    static constexpr uint64_t kIdle = std::numeric_limits<uint64_t>::max();
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{kIdle};
+        std::vector<std::pair<BwNode*, uint64_t>> garbage;  // owner thread only
+    };
+
+    static int thread_slot() {
+        static std::atomic<int> next_slot{0};
+        thread_local int slot = next_slot.fetch_add(1);
+        if (slot >= BW_MAX_THREADS) throw std::runtime_error("BwTree: too many threads for epoch manager");
+        return slot;
+    }
+
+    void reclaim(Slot& slot) {
+        global_epoch_.fetch_add(1);
+        uint64_t min_active = kIdle;
+        for (auto& s : slots_) min_active = std::min(min_active, s.epoch.load());
+        size_t kept = 0;
+        for (auto& g : slot.garbage) {
+            if (g.second < min_active) free_chain(g.first);
+            else slot.garbage[kept++] = g;
+        }
+        slot.garbage.resize(kept);
+    }
+
+    std::atomic<uint64_t> global_epoch_;
+    Slot slots_[BW_MAX_THREADS];
+};
+
+// -----------------------------------------------------------------------------
+// BwTree Class (latch-free, mapping table + delta chains)
+// -----------------------------------------------------------------------------
+// Same public surface as BPlusTree (put / get / rangeQuery / print_tree_stats) so
+// the benchmark driver can run either engine.
+class BwTree {
+public:
+    explicit BwTree(size_t mapping_capacity = BW_DEFAULT_MAPPING_CAPACITY)
+        : mapping_(new std::atomic<BwNode*>[mapping_capacity]), capacity_(mapping_capacity), next_pid_(0) {
+        for (size_t i = 0; i < capacity_; i++) mapping_[i].store(nullptr, std::memory_order_relaxed);
+        PID root = allocatePid();
+        mapping_[root].store(new BwLeafBase());
+        rootPid_.store(root);
+    }
+
+    ~BwTree() {
+        PID used = std::min<PID>(next_pid_.load(), capacity_);
+        for (PID i = 0; i < used; i++) BwEpochManager::free_chain(mapping_[i].load());
+    }
+
+    BwTree(const BwTree&) = delete;
+    BwTree& operator=(const BwTree&) = delete;
+
+    // Insert or update
+    void put(uint64_t key, const std::string& value) {
+        EpochGuard guard(epoch_);
+        std::vector<PID> path;
+        PID pid = findLeaf(key, &path);
+        BwLeafInsert* delta = new BwLeafInsert(key, value, nullptr);
+        installLeafDelta(pid, key, delta, path);
+        total_writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void del(uint64_t key) {
+        EpochGuard guard(epoch_);
+        std::vector<PID> path;
+        PID pid = findLeaf(key, &path);
+        BwLeafDelete* delta = new BwLeafDelete(key, nullptr);
+        installLeafDelta(pid, key, delta, path);
+        total_writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool get(uint64_t key, std::string& outValue) {
+        EpochGuard guard(epoch_);
+        total_reads.fetch_add(1, std::memory_order_relaxed);
+        PID pid = findLeaf(key, nullptr);
+        while (true) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            if (!head->covers(key)) {
+                pid = head->sibling;
+                continue;
+            }
+            return lookupInChain(head, key, outValue);
+        }
+    }
+
+    // Applies fn to the current value of key and installs the result as one delta,
+    // CASed against the page state the value was read from, so the read-modify-write
+    // is atomic. Returns false if key is absent.
+    bool update(uint64_t key, const BwValueUpdater& fn) { return readModifyWrite(key, nullptr, fn); }
+
+    // Like update(), but inserts defaultValue (without applying fn) if key is absent.
+    void upsert(uint64_t key, const std::string& defaultValue, const BwValueUpdater& fn) {
+        readModifyWrite(key, &defaultValue, fn);
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> rangeQuery(uint64_t low, uint64_t high, size_t max_results = 1000) {
+        std::vector<std::pair<uint64_t, std::string>> out;
+        if (low > high) return out;
+        EpochGuard guard(epoch_);
+        PID pid = findLeaf(low, nullptr);
+        std::vector<uint64_t> keys;
+        std::vector<std::string> values;
+        while (pid != BW_INVALID_PID && out.size() < max_results) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            materializeLeaf(head, keys, values);
+            for (size_t i = 0; i < keys.size() && out.size() < max_results; ++i) {
+                if (keys[i] < low) continue;
+                if (keys[i] > high) return out;
+                out.emplace_back(keys[i], values[i]);
+            }
+            if (!head->has_high || head->high_key > high) break;
+            pid = head->sibling;
+        }
+        return out;
+    }
+
+    void print_tree_stats() {
+        EpochGuard guard(epoch_);
+        size_t leaves = 0, inners = 0, depth = 0, deltas = 0, records = 0;
+        PID level_start = rootPid_.load();
+        while (level_start != BW_INVALID_PID) {
+            depth++;
+            PID next_level = BW_INVALID_PID;
+            for (PID pid = level_start; pid != BW_INVALID_PID;) {
+                BwNode* head = mapping_[pid].load();
+                deltas += head->chain_len;
+                BwNode* base = head;
+                while (base->next) base = base->next;
+                if (head->is_leaf) {
+                    leaves++;
+                    records += static_cast<BwLeafBase*>(base)->keys.size();
+                } else {
+                    inners++;
+                    if (next_level == BW_INVALID_PID) next_level = static_cast<BwInnerBase*>(base)->children[0];
+                }
+                pid = head->sibling;
+            }
+            level_start = next_level;
+        }
+        std::cout << "Bw-Tree Stats:\n";
+        std::cout << "  Root PID: " << rootPid_.load() << "\n";
+        std::cout << "  Mapping table: " << next_pid_.load() << "/" << capacity_ << " PIDs used\n";
+        std::cout << "  Tree Depth: " << depth << "\n";
+        std::cout << "  Total internal nodes: " << inners << "\n";
+        std::cout << "  Total leaf nodes: " << leaves << "\n";
+        std::cout << "  Leaf base records: " << records << "\n";
+        std::cout << "  Outstanding deltas: " << deltas << "\n";
+        std::cout << "  Consolidations: " << consolidations.load() << " | Splits: " << splits.load()
+                  << " | Failed CAS: " << failed_cas.load() << "\n";
+    }
+
+    std::atomic<int> total_reads{0};
+    std::atomic<int> total_writes{0};
+    std::atomic<uint64_t> consolidations{0};
+    std::atomic<uint64_t> splits{0};
+    std::atomic<uint64_t> failed_cas{0};
+
+private:
+    struct EpochGuard {
+        BwEpochManager& m;
+        explicit EpochGuard(BwEpochManager& mgr) : m(mgr) { m.enter(); }
+        ~EpochGuard() { m.exit(); }
+    };
+
+    std::unique_ptr<std::atomic<BwNode*>[]> mapping_;
+    size_t capacity_;
+    std::atomic<PID> next_pid_;
+    std::atomic<PID> rootPid_;
+    BwEpochManager epoch_;
+
+    PID allocatePid() {
+        PID pid = next_pid_.fetch_add(1);
+        if (pid >= capacity_) throw std::runtime_error("BwTree: mapping table is full");
+        return pid;
+    }
+
+    bool casPage(PID pid, BwNode* expected, BwNode* desired) {
+        if (mapping_[pid].compare_exchange_strong(expected, desired, std::memory_order_acq_rel)) return true;
+        failed_cas.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // ------------------------------------------------
+    // Traversal
+    // ------------------------------------------------
+    // Child of an inner page for key, or BW_INVALID_PID if the key is right of the page.
+    static PID routeInner(BwNode* head, uint64_t key) {
+        if (!head->covers(key)) return BW_INVALID_PID;
+        for (BwNode* n = head; n; n = n->next) {
+            if (n->type == BwNodeType::IndexEntry) {
+                auto* d = static_cast<BwIndexEntry*>(n);
+                if (d->routes(key)) return d->child;
+            } else if (n->type == BwNodeType::InnerBase) {
+                auto* b = static_cast<BwInnerBase*>(n);
+                size_t idx = std::upper_bound(b->keys.begin(), b->keys.end(), key) - b->keys.begin();
+                return b->children[idx];
+            }
+        }
+        return BW_INVALID_PID;
+    }
+
+    // Descends to the leaf page covering key. When path is given it receives the
+    // inner PIDs visited (root first) for posting index entries after a split.
+    PID findLeaf(uint64_t key, std::vector<PID>* path) {
+        PID pid = rootPid_.load(std::memory_order_acquire);
+        while (true) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            if (!head->covers(key)) {
+                pid = head->sibling;
+                continue;
+            }
+            if (head->is_leaf) return pid;
+            if (head->chain_len > BW_INNER_CONSOLIDATE_THRESHOLD && path) {
+                std::vector<PID> above(*path);
+                consolidate(pid, head, above);
+                continue;
+            }
+            if (path) path->push_back(pid);
+            pid = routeInner(head, key);
+        }
+    }
+
+    // Path from the root to (excluding) target, used when the recorded path is stale.
+    std::vector<PID> findParentPath(PID target, uint64_t key) {
+        std::vector<PID> path;
+        PID pid = rootPid_.load(std::memory_order_acquire);
+        while (pid != target) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            if (!head->covers(key)) {
+                pid = head->sibling;
+                continue;
+            }
+            if (head->is_leaf) break;
+            path.push_back(pid);
+            pid = routeInner(head, key);
+        }
+        return path;
+    }
+
+    // ------------------------------------------------
+    // Leaf updates
+    // ------------------------------------------------
+    static bool lookupInChain(BwNode* head, uint64_t key, std::string& outValue) {
+        for (BwNode* n = head; n; n = n->next) {
+            switch (n->type) {
+                case BwNodeType::LeafInsert: {
+                    auto* d = static_cast<BwLeafInsert*>(n);
+                    if (d->key == key) {
+                        outValue = d->value;
+                        return true;
+                    }
+                    break;
+                }
+                case BwNodeType::LeafDelete:
+                    if (static_cast<BwLeafDelete*>(n)->key == key) return false;
+                    break;
+                case BwNodeType::LeafBase: {
+                    auto* b = static_cast<BwLeafBase*>(n);
+                    auto it = std::lower_bound(b->keys.begin(), b->keys.end(), key);
+                    if (it == b->keys.end() || *it != key) return false;
+                    outValue = b->values[it - b->keys.begin()];
+                    return true;
+                }
+                default:
+                    break;  // split deltas are covered by the head's cached range
+            }
+        }
+        return false;
+    }
+
+    static void linkDelta(BwNode* delta, BwNode* head) {
+        delta->next = head;
+        delta->has_high = head->has_high;
+        delta->high_key = head->high_key;
+        delta->sibling = head->sibling;
+        delta->chain_len = head->chain_len + 1;
+    }
+
+    void installLeafDelta(PID pid, uint64_t key, BwNode* delta, std::vector<PID>& path) {
+        while (true) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            if (!head->covers(key)) {
+                pid = head->sibling;
+                continue;
+            }
+            linkDelta(delta, head);
+            if (casPage(pid, head, delta)) break;
+        }
+        if (delta->chain_len > BW_LEAF_CONSOLIDATE_THRESHOLD) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            consolidate(pid, head, path);
+        }
+    }
+
+    bool readModifyWrite(uint64_t key, const std::string* defaultValue, const BwValueUpdater& fn) {
+        EpochGuard guard(epoch_);
+        std::vector<PID> path;
+        PID pid = findLeaf(key, &path);
+        BwLeafInsert* delta = new BwLeafInsert(key, std::string(), nullptr);
+        while (true) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            if (!head->covers(key)) {
+                pid = head->sibling;
+                continue;
+            }
+            if (lookupInChain(head, key, delta->value)) {
+                fn(delta->value);
+            } else if (defaultValue) {
+                delta->value = *defaultValue;
+            } else {
+                delete delta;
+                return false;
+            }
+            linkDelta(delta, head);
+            if (casPage(pid, head, delta)) break;
+        }
+        total_writes.fetch_add(1, std::memory_order_relaxed);
+        if (delta->chain_len > BW_LEAF_CONSOLIDATE_THRESHOLD) {
+            BwNode* head = mapping_[pid].load(std::memory_order_acquire);
+            consolidate(pid, head, path);
+        }
+        return true;
+    }
+
+    // ------------------------------------------------
+    // Consolidation
+    // ------------------------------------------------
+    static void collectChain(BwNode* head, std::vector<BwNode*>& chain) {
+        chain.clear();
+        for (BwNode* n = head; n; n = n->next) chain.push_back(n);
+    }
+
+    static void materializeLeaf(BwNode* head, std::vector<uint64_t>& keys, std::vector<std::string>& values) {
+        std::vector<BwNode*> chain;
+        collectChain(head, chain);
+        auto* base = static_cast<BwLeafBase*>(chain.back());
+        keys = base->keys;
+        values = base->values;
+        // Replay oldest-first so the newest delta for a key wins.
+        for (size_t i = chain.size() - 1; i-- > 0;) {
+            BwNode* n = chain[i];
+            if (n->type == BwNodeType::LeafInsert) {
+                auto* d = static_cast<BwLeafInsert*>(n);
+                auto it = std::lower_bound(keys.begin(), keys.end(), d->key);
+                size_t pos = it - keys.begin();
+                if (it != keys.end() && *it == d->key) {
+                    values[pos] = d->value;
+                } else {
+                    keys.insert(it, d->key);
+                    values.insert(values.begin() + pos, d->value);
+                }
+            } else if (n->type == BwNodeType::LeafDelete) {
+                auto* d = static_cast<BwLeafDelete*>(n);
+                auto it = std::lower_bound(keys.begin(), keys.end(), d->key);
+                if (it != keys.end() && *it == d->key) {
+                    values.erase(values.begin() + (it - keys.begin()));
+                    keys.erase(it);
+                }
+            } else if (n->type == BwNodeType::Split) {
+                auto* d = static_cast<BwSplit*>(n);
+                size_t pos = std::lower_bound(keys.begin(), keys.end(), d->separator) - keys.begin();
+                keys.resize(pos);
+                values.resize(pos);
+            }
+        }
+    }
+
+    static void materializeInner(BwNode* head, std::vector<uint64_t>& keys, std::vector<PID>& children) {
+        std::vector<BwNode*> chain;
+        collectChain(head, chain);
+        auto* base = static_cast<BwInnerBase*>(chain.back());
+        keys = base->keys;
+        children = base->children;
+        for (size_t i = chain.size() - 1; i-- > 0;) {
+            BwNode* n = chain[i];
+            if (n->type == BwNodeType::IndexEntry) {
+                auto* d = static_cast<BwIndexEntry*>(n);
+                size_t pos = std::upper_bound(keys.begin(), keys.end(), d->separator) - keys.begin();
+                keys.insert(keys.begin() + pos, d->separator);
+                children.insert(children.begin() + pos + 1, d->child);
+            } else if (n->type == BwNodeType::Split) {
+                auto* d = static_cast<BwSplit*>(n);
+                size_t pos = std::lower_bound(keys.begin(), keys.end(), d->separator) - keys.begin();
+                keys.resize(pos);
+                children.resize(pos + 1);
+            }
+        }
+    }
+
+    // Replaces the chain at pid with a fresh base page, or splits the page when the
+    // consolidated contents overflow. path holds the ancestors of pid.
+    void consolidate(PID pid, BwNode* head, std::vector<PID>& path) {
+        if (head->chain_len == 0 && !overflows(head)) return;
+        BwNode* fresh;
+        size_t count;
+        if (head->is_leaf) {
+            auto* b = new BwLeafBase();
+            materializeLeaf(head, b->keys, b->values);
+            count = b->keys.size();
+            fresh = b;
+        } else {
+            auto* b = new BwInnerBase();
+            materializeInner(head, b->keys, b->children);
+            count = b->keys.size();
+            fresh = b;
+        }
+        fresh->has_high = head->has_high;
+        fresh->high_key = head->high_key;
+        fresh->sibling = head->sibling;
+
+        size_t max_count = head->is_leaf ? BW_MAX_LEAF_RECORDS : BW_MAX_INNER_KEYS;
+        if (count > max_count) {
+            splitPage(pid, head, fresh, path);
+            return;
+        }
+        if (casPage(pid, head, fresh)) {
+            consolidations.fetch_add(1, std::memory_order_relaxed);
+            epoch_.retire(head);
+        } else {
+            delete fresh;  // someone else changed the page; the next writer retries
+        }
+    }
+
+    static bool overflows(BwNode* base) {
+        if (base->type == BwNodeType::LeafBase) return static_cast<BwLeafBase*>(base)->keys.size() > BW_MAX_LEAF_RECORDS;
+        if (base->type == BwNodeType::InnerBase) return static_cast<BwInnerBase*>(base)->keys.size() > BW_MAX_INNER_KEYS;
+        return false;
+    }
+
+    // ------------------------------------------------
+    // Structure modification: split in two atomic steps
+    // ------------------------------------------------
+    // Step 1 installs the right half at a new PID and CASes a split delta (over the
+    // consolidated left half) onto the page; readers reach the new page through the
+    // split delta's sibling link.
+    // Step 2 posts an index entry delta to the parent (or grows a new root).
+    void splitPage(PID pid, BwNode* head, BwNode* fresh, std::vector<PID>& path) {
+        uint64_t separator;
+        BwNode* right;
+        if (fresh->is_leaf) {
+            auto* full = static_cast<BwLeafBase*>(fresh);
+            size_t mid = full->keys.size() / 2;
+            auto* r = new BwLeafBase();
+            r->keys.assign(full->keys.begin() + mid, full->keys.end());
+            r->values.assign(full->values.begin() + mid, full->values.end());
+            separator = r->keys.front();
+            full->keys.resize(mid);
+            full->values.resize(mid);
+            right = r;
+        } else {
+            auto* full = static_cast<BwInnerBase*>(fresh);
+            size_t mid = full->keys.size() / 2;
+            auto* r = new BwInnerBase();
+            separator = full->keys[mid];
+            r->keys.assign(full->keys.begin() + mid + 1, full->keys.end());
+            r->children.assign(full->children.begin() + mid + 1, full->children.end());
+            full->keys.resize(mid);
+            full->children.resize(mid + 1);
+            right = r;
+        }
+        right->has_high = fresh->has_high;
+        right->high_key = fresh->high_key;
+        right->sibling = fresh->sibling;
+
+        PID right_pid = allocatePid();
+        mapping_[right_pid].store(right, std::memory_order_release);
+        // The split delta sits on the consolidated left half rather than the old
+        // chain, so the split also consolidates the page.
+        BwSplit* split = new BwSplit(separator, right_pid, fresh);
+        if (!casPage(pid, head, split)) {
+            // Lost the race; the PID stays unused (the mapping table never recycles).
+            mapping_[right_pid].store(nullptr, std::memory_order_relaxed);
+            delete right;
+            BwEpochManager::free_chain(split);
+            return;
+        }
+        splits.fetch_add(1, std::memory_order_relaxed);
+        epoch_.retire(head);
+        postIndexEntry(pid, separator, right_pid, head->has_high, head->high_key, path);
+    }
+
+    void postIndexEntry(PID left, uint64_t separator, PID right, bool has_next, uint64_t next_key,
+                        std::vector<PID>& path) {
+        if (path.empty()) {
+            PID expected = left;
+            if (rootPid_.load() == left) {
+                auto* root = new BwInnerBase();
+                root->keys.push_back(separator);
+                root->children.push_back(left);
+                root->children.push_back(right);
+                PID root_pid = allocatePid();
+                mapping_[root_pid].store(root, std::memory_order_release);
+                if (rootPid_.compare_exchange_strong(expected, root_pid)) return;
+                mapping_[root_pid].store(nullptr, std::memory_order_relaxed);
+                delete root;
+            }
+            path = findParentPath(left, separator);
+            if (path.empty()) return;  // cannot happen once a new root exists
+        }
+        PID parent = path.back();
+        path.pop_back();
+        while (true) {
+            BwNode* head = mapping_[parent].load(std::memory_order_acquire);
+            if (!head->covers(separator)) {
+                parent = head->sibling;
+                continue;
+            }
+            // Clip the entry to the parent's own range so it never routes keys
+            // that belong to the parent's right sibling.
+            bool nk_has = has_next;
+            uint64_t nk = next_key;
+            if (head->has_high && (!nk_has || head->high_key < nk)) {
+                nk_has = true;
+                nk = head->high_key;
+            }
+            BwIndexEntry* entry = new BwIndexEntry(separator, nk_has, nk, right, head);
+            if (casPage(parent, head, entry)) {
+                if (entry->chain_len > BW_INNER_CONSOLIDATE_THRESHOLD) consolidate(parent, entry, path);
+                return;
+            }
+            entry->next = nullptr;
+            delete entry;
+        }
+    }
+};
+
+#endif  // BWTREE_H
@@ -0,0 +1,127 @@
+#ifndef FROZEN_INDEX_H
+#define FROZEN_INDEX_H
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+// Keys per block of the frozen search tree: one 64-byte cache line of uint64_t
+static const int FROZEN_BLOCK_KEYS = 8;
+
+// -----------------------------------------------------------------------------
+// FrozenIndex
+// -----------------------------------------------------------------------------
+// Immutable read replica of a sorted key set. Keys are packed into an implicit
+// (FROZEN_BLOCK_KEYS + 1)-ary search tree: block k's children are blocks
+// k * 9 + 1 .. k * 9 + 9, and blocks are stored in this Eytzinger (BFS) order, so a
+// lookup touches one cache line per level and needs no pointers or locks. Each block
+// is ranked against the search key with two AVX2 compares. Values live in a parallel
+// array at the same positions as their keys.
+class FrozenIndex {
+public:
+    // entries must be sorted by key without duplicates
+    explicit FrozenIndex(const std::vector<std::pair<uint64_t, std::string>> &entries) { build(entries); }
+
+    // Freezes the current contents of tree, read through a snapshot so writers keep going.
+    // This is safe with concurrent writers only because BPlusTree keeps nodes in a
+    // NodeArena, whose slots never move while the snapshot walks them.
+    explicit FrozenIndex(BPlusTree &tree) { build(tree.snapshot().rangeQuery(0, UINT64_MAX, SIZE_MAX)); }
+
+    FrozenIndex(const FrozenIndex &) = delete;
+    FrozenIndex &operator=(const FrozenIndex &) = delete;
+    ~FrozenIndex() { free(keys_); }
+
+    bool get(uint64_t key, std::string &outValue) const {
+        size_t k = 0;
+        size_t candidate = SIZE_MAX;  // slot of the smallest key >= key seen so far
+        uint64_t biased = key ^ SIGN_BIT;
+        while (k < numBlocks_) {
+            int i = rank(&keys_[k * FROZEN_BLOCK_KEYS], biased);
+            if (i < FROZEN_BLOCK_KEYS) candidate = k * FROZEN_BLOCK_KEYS + i;
+            k = k * (FROZEN_BLOCK_KEYS + 1) + i + 1;
+        }
+        if (candidate == SIZE_MAX || keys_[candidate] != biased || !present_[candidate]) return false;
+        outValue = values_[candidate];
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+    // Bytes used by keys and value slots (not counting heap-allocated long values)
+    size_t memoryBytes() const {
+        return numBlocks_ * FROZEN_BLOCK_KEYS * (sizeof(uint64_t) + sizeof(std::string));
+    }
+
+private:
+    // Keys are stored with the sign bit flipped so the signed AVX2 compare orders them
+    // as unsigned.
+    static const uint64_t SIGN_BIT = 1ULL << 63;
+
+    uint64_t *keys_ = nullptr;  // numBlocks_ * FROZEN_BLOCK_KEYS, 64-byte aligned
+    std::vector<std::string> values_;
+    std::vector<bool> present_;  // false for padding slots
+    size_t numBlocks_ = 0;
+    size_t size_ = 0;
+
+    // Number of keys in the block that are smaller than key (both biased)
+    static inline int rank(const uint64_t *block, uint64_t key) {
+#ifdef __AVX2__
+        __m256i x = _mm256_set1_epi64x(static_cast<long long>(key));
+        __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+        __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i *>(block + 4));
+        int maskLo = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, lo)));
+        int maskHi = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, hi)));
+        return __builtin_popcount(maskLo | (maskHi << 4));
+#else
+        int r = 0;
+        for (int i = 0; i < FROZEN_BLOCK_KEYS; i++) {
+            r += static_cast<int64_t>(block[i]) < static_cast<int64_t>(key);
+        }
+        return r;
+#endif
+    }
+
+    void build(const std::vector<std::pair<uint64_t, std::string>> &entries) {
+        size_ = entries.size();
+        numBlocks_ = (size_ + FROZEN_BLOCK_KEYS - 1) / FROZEN_BLOCK_KEYS;
+        size_t slots = numBlocks_ * FROZEN_BLOCK_KEYS;
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, std::max<size_t>(slots, 1) * sizeof(uint64_t)) != 0) throw std::bad_alloc();
+        keys_ = static_cast<uint64_t *>(p);
+        values_.assign(slots, std::string());
+        present_.assign(slots, false);
+        size_t next = 0;
+        fill(0, entries, next);
+    }
+
+    // In-order walk of the implicit tree hands out the sorted entries; slots past the
+    // end get the largest key so they never rank below a real one.
+    void fill(size_t k, const std::vector<std::pair<uint64_t, std::string>> &entries, size_t &next) {
+        if (k >= numBlocks_) return;
+        for (int i = 0; i < FROZEN_BLOCK_KEYS; i++) {
+            fill(k * (FROZEN_BLOCK_KEYS + 1) + i + 1, entries, next);
+            size_t slot = k * FROZEN_BLOCK_KEYS + i;
+            if (next < entries.size()) {
+                keys_[slot] = entries[next].first ^ SIGN_BIT;
+                values_[slot] = entries[next].second;
+                present_[slot] = true;
+                next++;
+            } else {
+                keys_[slot] = UINT64_MAX ^ SIGN_BIT;
+            }
+        }
+        fill(k * (FROZEN_BLOCK_KEYS + 1) + FROZEN_BLOCK_KEYS + 1, entries, next);
+    }
+};
+
+#endif  // FROZEN_INDEX_H
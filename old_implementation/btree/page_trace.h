@@ -0,0 +1,181 @@
+#ifndef PAGE_TRACE_H
+#define PAGE_TRACE_H
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compiles the tracing hooks out of the index entirely when 0. When 1, a disabled
+// tracer costs one relaxed load and a predictable branch per node visited.
+#ifndef ENABLE_PAGE_TRACE
+#define ENABLE_PAGE_TRACE 1
+#endif
+
+enum class TraceOp : uint8_t { Get = 0, Put = 1, Update = 2, Scan = 3 };
+
+// One node visit. Records are written to disk as-is (16 bytes, little endian).
+struct __attribute__((packed)) PageAccess {
+    uint64_t tsc;     // rdtsc at the visit, orders records across threads
+    uint32_t node;    // node index in the tree's arena
+    uint8_t level;    // depth below the root (root = 0)
+    uint8_t op;       // TraceOp
+    uint16_t thread;  // tracer-local thread id, in registration order
+};
+static_assert(sizeof(PageAccess) == 16, "PageAccess must stay 16 bytes");
+
+// Trace file layout: PageTraceHeader, then `records` PageAccess entries grouped by thread.
+static const uint32_t PAGE_TRACE_MAGIC = 0x43525450;  // "PTRC"
+static const uint16_t PAGE_TRACE_VERSION = 1;
+
+struct __attribute__((packed)) PageTraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t threads;
+    uint32_t reserved;
+    uint64_t records;
+    uint64_t overwritten;  // visits lost because a ring wrapped
+};
+
+// -----------------------------------------------------------------------------
+// PageTracer
+// -----------------------------------------------------------------------------
+// Each thread appends to its own fixed-size ring, so recording takes no lock and
+// shares no cache line with other threads; a full ring overwrites its oldest
+// entries. A thread registers (under a mutex) on its first visit after enable().
+// dump() and clear() must not race with traced operations.
+class PageTracer {
+public:
+    explicit PageTracer(size_t ringCapacity = size_t(1) << 20) : id_(nextId().fetch_add(1)) {
+        size_t cap = 1;
+        while (cap < ringCapacity) cap <<= 1;
+        capacity_ = cap;
+    }
+
+    void enable() { enabled_.store(true, std::memory_order_relaxed); }
+    void disable() { enabled_.store(false, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    inline void record(uint64_t node, int level, TraceOp op) {
+        if (__builtin_expect(!enabled(), 1)) return;
+        Ring *ring = localRing();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        PageAccess &rec = ring->records[head & (capacity_ - 1)];
+        rec.tsc = __rdtsc();
+        rec.node = static_cast<uint32_t>(node);
+        rec.level = static_cast<uint8_t>(level);
+        rec.op = static_cast<uint8_t>(op);
+        rec.thread = ring->thread;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    // Total visits recorded, including ones since overwritten
+    uint64_t recorded() const {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        uint64_t total = 0;
+        for (auto &r : rings_) total += r->head.load(std::memory_order_acquire);
+        return total;
+    }
+
+    // Writes every ring's surviving records, oldest first. Returns the record count.
+    uint64_t dump(const std::string &path) const {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        FILE *f = std::fopen(path.c_str(), "wb");
+        if (!f) throw std::runtime_error("cannot open page trace file " + path + ": " + std::strerror(errno));
+        PageTraceHeader hdr{};
+        hdr.magic = PAGE_TRACE_MAGIC;
+        hdr.version = PAGE_TRACE_VERSION;
+        hdr.recordSize = sizeof(PageAccess);
+        hdr.threads = static_cast<uint32_t>(rings_.size());
+        for (auto &r : rings_) {
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t kept = head < capacity_ ? head : capacity_;
+            hdr.records += kept;
+            hdr.overwritten += head - kept;
+        }
+        bool ok = std::fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+        for (auto &r : rings_) {
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t kept = head < capacity_ ? head : capacity_;
+            uint64_t first = (head - kept) & (capacity_ - 1);
+            // Oldest entries run from `first` to the end of the buffer, then wrap to 0
+            uint64_t tail = std::min<uint64_t>(kept, capacity_ - first);
+            ok = ok && std::fwrite(&r->records[first], sizeof(PageAccess), tail, f) == tail;
+            ok = ok && std::fwrite(&r->records[0], sizeof(PageAccess), kept - tail, f) == kept - tail;
+        }
+        if (std::fclose(f) != 0 || !ok) throw std::runtime_error("failed to write page trace file " + path);
+        return hdr.records;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        for (auto &r : rings_) r->head.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Ring {
+        std::atomic<uint64_t> head{0};  // next slot to write; only the owning thread stores
+        uint16_t thread = 0;
+        std::unique_ptr<PageAccess[]> records;
+    };
+
+    // Thread-local cache of the ring for one tracer. Keyed by tracer id (never
+    // reused), so a cache entry left by a destroyed tracer is never dereferenced.
+    struct LocalSlot {
+        uint64_t tracerId = UINT64_MAX;
+        Ring *ring = nullptr;
+    };
+
+    static std::atomic<uint64_t> &nextId() {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    Ring *localRing() {
+        static thread_local LocalSlot slot;
+        if (__builtin_expect(slot.tracerId == id_, 1)) return slot.ring;
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        std::thread::id self = std::this_thread::get_id();
+        Ring *ring = nullptr;
+        for (size_t i = 0; i < owners_.size(); i++) {
+            if (owners_[i] == self) ring = rings_[i].get();
+        }
+        if (!ring) {
+            auto fresh = std::make_unique<Ring>();
+            fresh->thread = static_cast<uint16_t>(rings_.size());
+            fresh->records.reset(new PageAccess[capacity_]);
+            ring = fresh.get();
+            rings_.push_back(std::move(fresh));
+            owners_.push_back(self);
+        }
+        slot.tracerId = id_;
+        slot.ring = ring;
+        return ring;
+    }
+
+    const uint64_t id_;
+    size_t capacity_;
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::vector<std::thread::id> owners_;
+};
+
+#if ENABLE_PAGE_TRACE
+#define PAGE_TRACE(tracer, node, level, op) (tracer).record((node), (level), (op))
+#else
+#define PAGE_TRACE(tracer, node, level, op) ((void)0)
+#endif
+
+#endif  // PAGE_TRACE_H
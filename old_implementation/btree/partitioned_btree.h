@@ -0,0 +1,277 @@
+#ifndef PARTITIONED_BTREE_H
+#define PARTITIONED_BTREE_H
+
+#include <immintrin.h>
+#include <numa.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+// Threads that may submit delegated writes to one PartitionedBPlusTree
+static const size_t MAX_DELEGATION_CLIENTS = 128;
+// Empty polling rounds before an owner thread yields its core
+static const int DELEGATION_IDLE_SPINS = 1024;
+
+// -----------------------------------------------------------------------------
+// PartitionedBPlusTree
+// -----------------------------------------------------------------------------
+// Splits the key space into P contiguous ranges, each served by an independent
+// BPlusTree, so threads working on different ranges share no nodes or locks. The
+// partition map is a sorted vector of lower bounds searched per operation. Range
+// scans visit the partitions overlapping [low, high] in key order.
+//
+// Each partition is assigned a NUMA node and built by a thread bound to it, but
+// that only places its initial root and leaves. Placement stays NUMA-local only in
+// delegation mode, where a pinned owner thread per partition performs all of that
+// partition's writes, so every node it allocates lands on the owner's node and its
+// write lock is never contended. Without delegation, nodes created by later splits
+// are allocated wherever the writing thread runs. Other threads post writes to a
+// per-client mailbox (a one-entry queue; the client waits for completion) and still
+// read partitions directly.
+class PartitionedBPlusTree {
+public:
+    // numPartitions equal-width ranges over [0, keySpace); the last one is open-ended.
+    // numaNodes lists the nodes to place partitions on, round robin (empty: all nodes).
+    PartitionedBPlusTree(size_t numPartitions, uint64_t keySpace, bool delegation = false,
+                         std::vector<int> numaNodes = {})
+        : PartitionedBPlusTree(equalRanges(numPartitions, keySpace), delegation, std::move(numaNodes)) {}
+
+    // lowerBounds[p] is the first key of partition p; lowerBounds[0] must be 0.
+    PartitionedBPlusTree(std::vector<uint64_t> lowerBounds, bool delegation, std::vector<int> numaNodes = {})
+        : lowerBounds_(std::move(lowerBounds)), delegation_(delegation) {
+        if (lowerBounds_.empty() || lowerBounds_[0] != 0 || !std::is_sorted(lowerBounds_.begin(), lowerBounds_.end())) {
+            throw std::runtime_error("partition lower bounds must be sorted and start at 0");
+        }
+        if (numaNodes.empty() && numa_available() >= 0) {
+            for (int n = 0; n <= numa_max_node(); n++) numaNodes.push_back(n);
+        }
+        for (size_t p = 0; p < lowerBounds_.size(); p++) partitions_.push_back(std::make_unique<Partition>());
+        for (size_t p = 0; p < partitions_.size(); p++) {
+            Partition &part = *partitions_[p];
+            part.numaNode = numaNodes.empty() ? -1 : numaNodes[p % numaNodes.size()];
+            part.mailboxes.reset(new Mailbox[MAX_DELEGATION_CLIENTS]);
+            // Build on the partition's node so the root and first leaves are local; later
+            // nodes follow the writer, which is the owner only in delegation mode
+            std::thread builder([&part] {
+                bindToNode(part.numaNode);
+                part.tree = std::make_unique<BPlusTree>();
+            });
+            builder.join();
+        }
+        if (delegation_) {
+            for (auto &part : partitions_) {
+                Partition *owned = part.get();
+                part->owner = std::thread([this, owned] { ownerLoop(*owned); });
+            }
+        }
+    }
+
+    ~PartitionedBPlusTree() {
+        stop_.store(true, std::memory_order_release);
+        for (auto &part : partitions_) {
+            {
+                std::lock_guard<std::mutex> lock(part->parkMutex);
+                part->parkCv.notify_one();
+            }
+            if (part->owner.joinable()) part->owner.join();
+        }
+    }
+
+    PartitionedBPlusTree(const PartitionedBPlusTree &) = delete;
+    PartitionedBPlusTree &operator=(const PartitionedBPlusTree &) = delete;
+
+    size_t partitionOf(uint64_t key) const {
+        return std::upper_bound(lowerBounds_.begin(), lowerBounds_.end(), key) - lowerBounds_.begin() - 1;
+    }
+
+    size_t numPartitions() const { return partitions_.size(); }
+
+    void put(uint64_t key, const std::string &value) {
+        Partition &part = *partitions_[partitionOf(key)];
+        if (!delegation_) return part.tree->put(key, value);
+        delegate(part, DelegatedOp::Put, key, &value, nullptr);
+    }
+
+    bool update(uint64_t key, const ValueUpdater &fn) {
+        Partition &part = *partitions_[partitionOf(key)];
+        if (!delegation_) return part.tree->update(key, fn);
+        return delegate(part, DelegatedOp::Update, key, nullptr, &fn);
+    }
+
+    void upsert(uint64_t key, const std::string &defaultValue, const ValueUpdater &fn) {
+        Partition &part = *partitions_[partitionOf(key)];
+        if (!delegation_) return part.tree->upsert(key, defaultValue, fn);
+        delegate(part, DelegatedOp::Upsert, key, &defaultValue, &fn);
+    }
+
+    bool get(uint64_t key, std::string &outValue) { return partitions_[partitionOf(key)]->tree->get(key, outValue); }
+
+    std::vector<std::pair<uint64_t, std::string>> rangeQuery(uint64_t low, uint64_t high,
+                                                             size_t max_results = MAX_RANGE_RESULTS) {
+        std::vector<std::pair<uint64_t, std::string>> out;
+        if (low > high) return out;
+        for (size_t p = partitionOf(low); p < partitions_.size() && out.size() < max_results; p++) {
+            if (lowerBounds_[p] > high) break;
+            auto part = partitions_[p]->tree->rangeQuery(low, high, max_results - out.size());
+            out.insert(out.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+        }
+        return out;
+    }
+
+    void print_tree_stats() {
+        std::cout << "Partitioned B+ Tree: " << partitions_.size() << " partitions, "
+                  << (delegation_ ? "delegated" : "shared") << " writes\n";
+        for (size_t p = 0; p < partitions_.size(); p++) {
+            std::cout << "Partition " << p << " [" << lowerBounds_[p] << ", "
+                      << (p + 1 < partitions_.size() ? std::to_string(lowerBounds_[p + 1]) : std::string("max"))
+                      << ") on NUMA node " << partitions_[p]->numaNode
+                      << (delegation_ ? "" : " (initial nodes only; later nodes follow the writer)") << ":\n";
+            partitions_[p]->tree->print_tree_stats();
+        }
+    }
+
+private:
+    enum class DelegatedOp : uint32_t { Put, Update, Upsert };
+
+    // One outstanding request per client thread and partition
+    struct alignas(64) Mailbox {
+        std::atomic<uint32_t> state{IDLE};
+        DelegatedOp op = DelegatedOp::Put;
+        uint64_t key = 0;
+        const std::string *value = nullptr;
+        const ValueUpdater *fn = nullptr;
+        bool result = false;
+    };
+    static const uint32_t IDLE = 0, PENDING = 1, DONE = 2;
+
+    struct Partition {
+        std::unique_ptr<BPlusTree> tree;
+        int numaNode = -1;
+        std::unique_ptr<Mailbox[]> mailboxes;  // indexed by client slot
+        std::thread owner;
+        // An owner that found no work for DELEGATION_IDLE_SPINS rounds sleeps here
+        std::mutex parkMutex;
+        std::condition_variable parkCv;
+        std::atomic<bool> parked{false};
+    };
+
+    std::vector<uint64_t> lowerBounds_;
+    std::vector<std::unique_ptr<Partition>> partitions_;
+    bool delegation_;
+    std::atomic<bool> stop_{false};
+    std::atomic<size_t> numClients_{0};
+    const uint64_t id_ = nextId().fetch_add(1);
+
+    static std::atomic<uint64_t> &nextId() {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    static std::vector<uint64_t> equalRanges(size_t numPartitions, uint64_t keySpace) {
+        if (numPartitions == 0) throw std::runtime_error("need at least one partition");
+        std::vector<uint64_t> bounds;
+        for (size_t p = 0; p < numPartitions; p++) bounds.push_back(keySpace / numPartitions * p);
+        return bounds;
+    }
+
+    static void bindToNode(int node) {
+        if (node < 0 || numa_available() < 0) return;
+        numa_run_on_node(node);
+        numa_set_preferred(node);
+    }
+
+    // Mailbox slot of the calling thread, assigned on its first delegated write
+    size_t clientSlot() {
+        struct LocalSlot {
+            uint64_t treeId = UINT64_MAX;
+            size_t slot = 0;
+        };
+        static thread_local LocalSlot local;
+        if (local.treeId == id_) return local.slot;
+        size_t slot = numClients_.fetch_add(1);
+        if (slot >= MAX_DELEGATION_CLIENTS) throw std::runtime_error("too many delegation clients");
+        local.treeId = id_;
+        local.slot = slot;
+        return slot;
+    }
+
+    bool delegate(Partition &part, DelegatedOp op, uint64_t key, const std::string *value, const ValueUpdater *fn) {
+        Mailbox &box = part.mailboxes[clientSlot()];
+        box.op = op;
+        box.key = key;
+        box.value = value;
+        box.fn = fn;
+        box.state.store(PENDING);
+        if (part.parked.load()) {
+            std::lock_guard<std::mutex> lock(part.parkMutex);
+            part.parkCv.notify_one();
+        }
+        while (box.state.load(std::memory_order_acquire) != DONE) _mm_pause();
+        box.state.store(IDLE, std::memory_order_relaxed);
+        return box.result;
+    }
+
+    bool hasPending(Partition &part) {
+        size_t clients = std::min(numClients_.load(), MAX_DELEGATION_CLIENTS);
+        for (size_t c = 0; c < clients; c++) {
+            if (part.mailboxes[c].state.load() == PENDING) return true;
+        }
+        return false;
+    }
+
+    void ownerLoop(Partition &part) {
+        bindToNode(part.numaNode);
+        int idle = 0;
+        while (!stop_.load(std::memory_order_acquire)) {
+            bool served = false;
+            size_t clients = std::min(numClients_.load(std::memory_order_acquire), MAX_DELEGATION_CLIENTS);
+            for (size_t c = 0; c < clients; c++) {
+                Mailbox &box = part.mailboxes[c];
+                if (box.state.load(std::memory_order_acquire) != PENDING) continue;
+                switch (box.op) {
+                    case DelegatedOp::Put:
+                        part.tree->put(box.key, *box.value);
+                        box.result = true;
+                        break;
+                    case DelegatedOp::Update:
+                        box.result = part.tree->update(box.key, *box.fn);
+                        break;
+                    case DelegatedOp::Upsert:
+                        part.tree->upsert(box.key, *box.value, *box.fn);
+                        box.result = true;
+                        break;
+                }
+                box.state.store(DONE, std::memory_order_release);
+                served = true;
+            }
+            if (served) {
+                idle = 0;
+            } else if (++idle >= DELEGATION_IDLE_SPINS) {
+                // parked is published before the final check, so a client posting
+                // concurrently either sees it and notifies or is seen here
+                std::unique_lock<std::mutex> lock(part.parkMutex);
+                part.parked.store(true);
+                if (!hasPending(part) && !stop_.load()) part.parkCv.wait_for(lock, std::chrono::milliseconds(10));
+                part.parked.store(false);
+                idle = 0;
+            } else {
+                _mm_pause();
+            }
+        }
+    }
+};
+
+#endif  // PARTITIONED_BTREE_H
@@ -0,0 +1,567 @@
+#ifndef VARKEY_BTREE_H
+#define VARKEY_BTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+// -----------------------------------------------------------------------------
+// VARIABLE-LENGTH KEY B+ TREE CONSTANTS
+// -----------------------------------------------------------------------------
+static const size_t VARKEY_HEAD_BYTES = 8;  // inline normalized key prefix
+// A leaf must always be able to hold two records after a split
+static const size_t VARKEY_MAX_RECORD = 1000;
+// Separator candidates considered on either side of a leaf's byte midpoint
+static const double VARKEY_SPLIT_WINDOW = 0.125;
+
+// First 8 key bytes as a big-endian integer, zero padded. Integer order of two heads
+// matches byte order of the keys whenever the heads differ.
+static inline uint64_t varKeyHead(const char *key, size_t len) {
+    uint64_t head = 0;
+    size_t n = std::min(len, VARKEY_HEAD_BYTES);
+    for (size_t i = 0; i < n; i++) head |= static_cast<uint64_t>(static_cast<uint8_t>(key[i])) << (56 - 8 * i);
+    return head;
+}
+
+// Three-way compare of two keys given their heads, the bytes after the head
+// (tails) and the full lengths.
+static inline int varKeyCompare(uint64_t headA, const char *tailA, size_t lenA, uint64_t headB, const char *tailB,
+                                size_t lenB) {
+    if (headA != headB) return headA < headB ? -1 : 1;
+    size_t tA = lenA > VARKEY_HEAD_BYTES ? lenA - VARKEY_HEAD_BYTES : 0;
+    size_t tB = lenB > VARKEY_HEAD_BYTES ? lenB - VARKEY_HEAD_BYTES : 0;
+    int c = std::memcmp(tailA, tailB, std::min(tA, tB));
+    if (c != 0) return c;
+    return lenA < lenB ? -1 : (lenA > lenB ? 1 : 0);
+}
+
+static inline int varKeyCompare(const std::string &a, const std::string &b) {
+    return varKeyCompare(varKeyHead(a.data(), a.size()), a.data() + std::min(a.size(), VARKEY_HEAD_BYTES), a.size(),
+                         varKeyHead(b.data(), b.size()), b.data() + std::min(b.size(), VARKEY_HEAD_BYTES), b.size());
+}
+
+// -----------------------------------------------------------------------------
+// Slotted leaf page
+// -----------------------------------------------------------------------------
+// A NODE_SIZE page: header, then a sorted slot array growing up, and a record heap
+// growing down from the end. A slot carries the key's 8-byte head, so most
+// comparisons never touch the heap; the heap holds only the key bytes past the
+// head, followed by the value.
+struct VarSlot {
+    uint64_t head;
+    uint16_t offset;  // of the record in body
+    uint16_t keyLen;
+    uint16_t valLen;
+    uint16_t unused;
+};
+
+struct VarLeafPage {
+    static const size_t BODY_SIZE = NODE_SIZE - 8;
+
+    uint16_t numSlots = 0;
+    uint16_t heapTop = BODY_SIZE;  // lowest heap byte in use
+    uint16_t liveHeap = 0;         // heap bytes still referenced by a slot
+    uint16_t unused = 0;
+    alignas(8) char body[BODY_SIZE];
+
+    static size_t tailLen(size_t keyLen) { return keyLen > VARKEY_HEAD_BYTES ? keyLen - VARKEY_HEAD_BYTES : 0; }
+    static size_t recordBytes(size_t keyLen, size_t valLen) { return sizeof(VarSlot) + tailLen(keyLen) + valLen; }
+
+    VarSlot *slots() { return reinterpret_cast<VarSlot *>(body); }
+    const VarSlot *slots() const { return reinterpret_cast<const VarSlot *>(body); }
+
+    size_t usedBytes() const { return numSlots * sizeof(VarSlot) + liveHeap; }
+    bool fits(size_t keyLen, size_t valLen) const { return usedBytes() + recordBytes(keyLen, valLen) <= BODY_SIZE; }
+
+    const char *tail(const VarSlot &s) const { return body + s.offset; }
+    const char *value(const VarSlot &s) const { return body + s.offset + tailLen(s.keyLen); }
+
+    std::string keyAt(size_t i) const {
+        const VarSlot &s = slots()[i];
+        std::string key(s.keyLen, '\0');
+        for (size_t b = 0; b < std::min<size_t>(s.keyLen, VARKEY_HEAD_BYTES); b++) key[b] = char(s.head >> (56 - 8 * b));
+        if (s.keyLen > VARKEY_HEAD_BYTES) std::memcpy(&key[VARKEY_HEAD_BYTES], tail(s), tailLen(s.keyLen));
+        return key;
+    }
+    std::string valueAt(size_t i) const {
+        const VarSlot &s = slots()[i];
+        return std::string(value(s), s.valLen);
+    }
+
+    // First slot whose key is >= key; found is set if it is equal.
+    size_t lowerBound(const std::string &key, bool &found) const {
+        uint64_t head = varKeyHead(key.data(), key.size());
+        const char *keyTail = key.data() + std::min(key.size(), VARKEY_HEAD_BYTES);
+        size_t lo = 0, hi = numSlots;
+        found = false;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            const VarSlot &s = slots()[mid];
+            int c = varKeyCompare(s.head, tail(s), s.keyLen, head, keyTail, key.size());
+            if (c < 0) {
+                lo = mid + 1;
+            } else {
+                if (c == 0) found = true;
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // Caller checked fits(); compacts the heap if its free bytes are fragmented.
+    void insertAt(size_t pos, const std::string &key, const std::string &val) {
+        size_t tl = tailLen(key.size());
+        if (heapTop - numSlots * sizeof(VarSlot) < sizeof(VarSlot) + tl + val.size()) compact();
+        heapTop -= tl + val.size();
+        std::memcpy(body + heapTop, key.data() + VARKEY_HEAD_BYTES * (tl > 0), tl);
+        std::memcpy(body + heapTop + tl, val.data(), val.size());
+        liveHeap += tl + val.size();
+        std::memmove(&slots()[pos + 1], &slots()[pos], (numSlots - pos) * sizeof(VarSlot));
+        VarSlot &s = slots()[pos];
+        s.head = varKeyHead(key.data(), key.size());
+        s.offset = heapTop;
+        s.keyLen = static_cast<uint16_t>(key.size());
+        s.valLen = static_cast<uint16_t>(val.size());
+        s.unused = 0;
+        numSlots++;
+    }
+
+    void eraseAt(size_t pos) {
+        liveHeap -= tailLen(slots()[pos].keyLen) + slots()[pos].valLen;
+        std::memmove(&slots()[pos], &slots()[pos + 1], (numSlots - pos - 1) * sizeof(VarSlot));
+        numSlots--;
+    }
+
+    void compact() {
+        std::unique_ptr<char[]> copy(new char[BODY_SIZE]);
+        std::memcpy(copy.get(), body, BODY_SIZE);
+        uint16_t top = BODY_SIZE;
+        for (size_t i = 0; i < numSlots; i++) {
+            VarSlot &s = slots()[i];
+            size_t bytes = tailLen(s.keyLen) + s.valLen;
+            top -= bytes;
+            std::memcpy(body + top, copy.get() + s.offset, bytes);
+            s.offset = top;
+        }
+        heapTop = top;
+    }
+
+    void clear() {
+        numSlots = 0;
+        heapTop = BODY_SIZE;
+        liveHeap = 0;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Prefix-compressed internal node
+// -----------------------------------------------------------------------------
+// Separators are stored without their longest common prefix, each with the 8-byte
+// head of its remaining suffix. A node splits once its encoded size passes NODE_SIZE.
+struct VarNode;
+
+struct VarInternalNode {
+    std::string prefix;
+    std::vector<uint64_t> heads;
+    std::vector<std::string> suffixes;
+    std::vector<VarNode *> children;  // suffixes.size() + 1 entries
+
+    size_t numKeys() const { return suffixes.size(); }
+    std::string separator(size_t i) const { return prefix + suffixes[i]; }
+
+    size_t encodedBytes() const {
+        size_t bytes = 16 + prefix.size() + children.size() * sizeof(uint64_t);
+        for (auto &s : suffixes) bytes += VARKEY_HEAD_BYTES + sizeof(uint16_t) + VarLeafPage::tailLen(s.size());
+        return bytes;
+    }
+
+    // Index of the child covering key (keys >= separator i go right of it)
+    size_t childFor(const std::string &key) const {
+        size_t plen = prefix.size();
+        int c = std::memcmp(key.data(), prefix.data(), std::min(plen, key.size()));
+        if (c < 0 || (c == 0 && key.size() < plen)) return 0;
+        if (c > 0) return numKeys();
+        const char *rest = key.data() + plen;
+        size_t restLen = key.size() - plen;
+        uint64_t head = varKeyHead(rest, restLen);
+        const char *restTail = rest + std::min(restLen, VARKEY_HEAD_BYTES);
+        size_t lo = 0, hi = numKeys();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            const std::string &s = suffixes[mid];
+            int cmp = varKeyCompare(heads[mid], s.data() + std::min(s.size(), VARKEY_HEAD_BYTES), s.size(), head,
+                                    restTail, restLen);
+            if (cmp <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    void assign(const std::vector<std::string> &seps, std::vector<VarNode *> kids) {
+        size_t plen = seps.empty() ? 0 : seps.front().size();
+        for (size_t i = 1; i < seps.size() && plen > 0; i++) {
+            size_t l = 0;
+            size_t max = std::min(plen, seps[i].size());
+            while (l < max && seps[i][l] == seps[0][l]) l++;
+            plen = l;
+        }
+        prefix = seps.empty() ? std::string() : seps.front().substr(0, plen);
+        suffixes.clear();
+        heads.clear();
+        for (auto &s : seps) {
+            suffixes.push_back(s.substr(plen));
+            heads.push_back(varKeyHead(suffixes.back().data(), suffixes.back().size()));
+        }
+        children = std::move(kids);
+    }
+
+    std::vector<std::string> separators() const {
+        std::vector<std::string> seps;
+        seps.reserve(numKeys() + 1);
+        for (size_t i = 0; i < numKeys(); i++) seps.push_back(separator(i));
+        return seps;
+    }
+
+    // Adds sep with right as the child to its right, at position i
+    void insertSeparator(size_t i, const std::string &sep, VarNode *right) {
+        if (sep.size() >= prefix.size() && sep.compare(0, prefix.size(), prefix) == 0) {
+            suffixes.insert(suffixes.begin() + i, sep.substr(prefix.size()));
+            heads.insert(heads.begin() + i, varKeyHead(suffixes[i].data(), suffixes[i].size()));
+            children.insert(children.begin() + i + 1, right);
+            return;
+        }
+        // The common prefix shrinks: re-encode every separator
+        std::vector<std::string> seps = separators();
+        seps.insert(seps.begin() + i, sep);
+        std::vector<VarNode *> kids = children;
+        kids.insert(kids.begin() + i + 1, right);
+        assign(seps, std::move(kids));
+    }
+};
+
+struct VarNode {
+    NodeType type;
+    std::unique_ptr<VarLeafPage> leaf;
+    std::unique_ptr<VarInternalNode> internal;
+    VarNode *nextLeaf = nullptr;
+    mutable std::shared_mutex node_mutex;
+    explicit VarNode(NodeType t) : type(t) {
+        if (t == NodeType::Leaf) {
+            leaf = std::make_unique<VarLeafPage>();
+        } else {
+            internal = std::make_unique<VarInternalNode>();
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+// VarKeyBPlusTree
+// -----------------------------------------------------------------------------
+// BPlusTree over std::string keys and values. Unlike BPlusTree, every writer holds
+// tree_mutex exclusively for the whole insert, so writes are fully serialized, and it
+// keeps each node on its path locked exclusively top-down until the insert returns.
+// Readers skip tree_mutex: they shared-lock the root, retry if root_ changed under
+// them, and couple shared node locks down to the leaf. Leaf splits pick, near the byte midpoint, the boundary
+// with the shortest separator and promote only the bytes needed to tell the two
+// sides apart (suffix truncation).
+class VarKeyBPlusTree {
+public:
+    VarKeyBPlusTree() { root_.store(newNode(NodeType::Leaf)); }
+
+    void put(const std::string &key, const std::string &value) { write(key, value, nullptr); }
+
+    bool update(const std::string &key, const ValueUpdater &fn) {
+        WriteOp op;
+        op.updater = &fn;
+        op.insertIfMissing = false;
+        write(key, std::string(), &op);
+        return op.applied;
+    }
+
+    void upsert(const std::string &key, const std::string &defaultValue, const ValueUpdater &fn) {
+        WriteOp op;
+        op.updater = &fn;
+        write(key, defaultValue, &op);
+    }
+
+    bool get(const std::string &key, std::string &outValue) {
+        while (true) {
+            VarNode *root = root_.load(std::memory_order_acquire);
+            std::shared_lock<std::shared_mutex> rootLock(root->node_mutex);
+            if (root != root_.load(std::memory_order_acquire)) continue;  // root split under us
+            return searchKey(root, std::move(rootLock), key, outValue);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> rangeQuery(const std::string &low, const std::string &high,
+                                                                 size_t max_results = MAX_RANGE_RESULTS) {
+        std::vector<std::pair<std::string, std::string>> out;
+        if (varKeyCompare(low, high) > 0) return out;
+        VarNode *leafNode = findLeafForKey(low);
+        bool found;
+        size_t i = 0;
+        bool first = true;
+        while (leafNode && out.size() < max_results) {
+            std::shared_lock<std::shared_mutex> leafLock(leafNode->node_mutex);
+            const VarLeafPage *page = leafNode->leaf.get();
+            i = first ? page->lowerBound(low, found) : 0;
+            first = false;
+            for (; i < page->numSlots && out.size() < max_results; i++) {
+                std::string k = page->keyAt(i);
+                if (varKeyCompare(k, low) < 0) continue;
+                if (varKeyCompare(k, high) > 0) return out;
+                out.emplace_back(std::move(k), page->valueAt(i));
+            }
+            leafNode = leafNode->nextLeaf;
+        }
+        return out;
+    }
+
+    void print_tree_stats() {
+        std::shared_lock<std::shared_mutex> treeLock(tree_mutex);
+        Stats st;
+        collectStats(root_.load(), 1, st);
+        std::cout << "Variable-length key B+ Tree Stats:\n";
+        std::cout << "  Node Size: " << NODE_SIZE << "\n";
+        std::cout << "  Tree Depth: " << st.depth << "\n";
+        std::cout << "  Total Nodes: " << st.internals + st.leaves << "\n";
+        std::cout << "  Total internal nodes: " << st.internals << "\n";
+        std::cout << "  Total leaf nodes: " << st.leaves << "\n";
+        std::cout << "  Total keys: " << st.keys << "\n";
+        std::cout << "  Leaf fill factor: "
+                  << (st.leaves ? double(st.leafBytes) / (double(st.leaves) * VarLeafPage::BODY_SIZE) : 0.0) << "\n";
+        std::cout << "  Avg separator length (bytes): "
+                  << (st.separators ? double(st.separatorBytes) / st.separators : 0.0) << "\n";
+        std::cout << "  Avg stored separator suffix (bytes): "
+                  << (st.separators ? double(st.suffixBytes) / st.separators : 0.0) << "\n";
+        std::cout << "  Total Size (in MB): " << ((st.internals + st.leaves) * NODE_SIZE) / (1024.0 * 1024.0) << "\n";
+    }
+
+    mutable std::shared_mutex tree_mutex;  // serializes writers
+
+private:
+    struct SplitResult {
+        bool splitted = false;
+        std::string separator;
+        VarNode *right = nullptr;
+    };
+
+    struct Stats {
+        int depth = 0;
+        size_t internals = 0, leaves = 0, keys = 0, leafBytes = 0;
+        size_t separators = 0, separatorBytes = 0, suffixBytes = 0;
+    };
+
+    std::atomic<VarNode *> root_{nullptr};
+    std::vector<std::unique_ptr<VarNode>> nodes_;  // owns every node; guarded by tree_mutex
+
+    VarNode *newNode(NodeType type) {
+        nodes_.emplace_back(std::make_unique<VarNode>(type));
+        return nodes_.back().get();
+    }
+
+    static void checkSizes(const std::string &key, const std::string &value) {
+        if (key.empty() || key.size() + value.size() > VARKEY_MAX_RECORD) {
+            throw std::runtime_error("variable-length key/value must be non-empty and at most " +
+                                     std::to_string(VARKEY_MAX_RECORD) + " bytes combined");
+        }
+    }
+
+    // ------------------------------------------------
+    // Search
+    // ------------------------------------------------
+    bool searchKey(VarNode *node, [[maybe_unused]] std::shared_lock<std::shared_mutex> lock, const std::string &key,
+                   std::string &outValue) {
+        if (node->type == NodeType::Leaf) {
+            bool found;
+            size_t pos = node->leaf->lowerBound(key, found);
+            if (found) outValue = node->leaf->valueAt(pos);
+            return found;
+        }
+        VarNode *child = node->internal->children[node->internal->childFor(key)];
+        std::shared_lock<std::shared_mutex> childLock(child->node_mutex);
+        return searchKey(child, std::move(childLock), key, outValue);
+    }
+
+    VarNode *findLeafForKey(const std::string &key) {
+        while (true) {
+            VarNode *node = root_.load(std::memory_order_acquire);
+            std::shared_lock<std::shared_mutex> lock(node->node_mutex);
+            if (node != root_.load(std::memory_order_acquire)) continue;
+            while (node->type == NodeType::Internal) {
+                VarNode *child = node->internal->children[node->internal->childFor(key)];
+                std::shared_lock<std::shared_mutex> childLock(child->node_mutex);
+                lock = std::move(childLock);
+                node = child;
+            }
+            return node;
+        }
+    }
+
+    // ------------------------------------------------
+    // Insert
+    // ------------------------------------------------
+    void write(const std::string &key, const std::string &value, WriteOp *op) {
+        checkSizes(key, value);
+        std::unique_lock<std::shared_mutex> treeLock(tree_mutex);
+        VarNode *root = root_.load();
+        SplitResult res = insertInternal(root, key, value, op);
+        if (res.splitted) {
+            VarNode *newRoot = newNode(NodeType::Internal);
+            newRoot->internal->assign({res.separator}, {root, res.right});
+            root_.store(newRoot, std::memory_order_release);
+        }
+    }
+
+    SplitResult insertInternal(VarNode *node, const std::string &key, const std::string &val, WriteOp *op) {
+        std::unique_lock<std::shared_mutex> nodeLock(node->node_mutex);
+        if (node->type == NodeType::Leaf) return insertLeaf(node, key, val, op);
+
+        VarInternalNode *internal = node->internal.get();
+        size_t i = internal->childFor(key);
+        SplitResult cRes = insertInternal(internal->children[i], key, val, op);
+        if (!cRes.splitted) return {};
+        internal->insertSeparator(i, cRes.separator, cRes.right);
+        if (internal->encodedBytes() <= NODE_SIZE) return {};
+        return splitInternal(node);
+    }
+
+    SplitResult insertLeaf(VarNode *node, const std::string &key, const std::string &val, WriteOp *op) {
+        VarLeafPage *page = node->leaf.get();
+        bool found;
+        size_t pos = page->lowerBound(key, found);
+        std::string newVal = val;
+        if (found) {
+            if (op && op->updater) {
+                newVal = page->valueAt(pos);
+                (*op->updater)(newVal);
+                checkSizes(key, newVal);
+            }
+            page->eraseAt(pos);
+        } else if (op && !op->insertIfMissing) {
+            return {};
+        }
+        if (op) op->applied = true;
+        if (page->fits(key.size(), newVal.size())) {
+            page->insertAt(pos, key, newVal);
+            return {};
+        }
+        return splitLeaf(node, pos, key, newVal);
+    }
+
+    SplitResult splitLeaf(VarNode *node, size_t pos, const std::string &key, const std::string &val) {
+        VarLeafPage *page = node->leaf.get();
+        std::vector<std::pair<std::string, std::string>> entries;
+        entries.reserve(page->numSlots + 1);
+        for (size_t i = 0; i < page->numSlots; i++) entries.emplace_back(page->keyAt(i), page->valueAt(i));
+        entries.insert(entries.begin() + pos, {key, val});
+
+        // prefixBytes[i]: encoded size of entries [0, i)
+        size_t n = entries.size();
+        std::vector<size_t> prefixBytes(n + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            prefixBytes[i + 1] = prefixBytes[i] + VarLeafPage::recordBytes(entries[i].first.size(), entries[i].second.size());
+        }
+        auto fitsBoth = [&](size_t split) {
+            return prefixBytes[split] <= VarLeafPage::BODY_SIZE &&
+                   prefixBytes[n] - prefixBytes[split] <= VarLeafPage::BODY_SIZE;
+        };
+        size_t mid = 1;
+        while (mid < n - 1 && prefixBytes[mid] * 2 < prefixBytes[n]) mid++;
+        size_t window = std::max<size_t>(1, static_cast<size_t>(n * VARKEY_SPLIT_WINDOW));
+        size_t best = SIZE_MAX;
+        size_t bestLen = SIZE_MAX;
+        for (size_t split = (mid > window ? mid - window : 1); split <= std::min(n - 1, mid + window); split++) {
+            if (!fitsBoth(split)) continue;
+            size_t len = separatorLength(entries[split - 1].first, entries[split].first);
+            size_t dist = split > mid ? split - mid : mid - split;
+            size_t bestDist = best == SIZE_MAX ? SIZE_MAX : (best > mid ? best - mid : mid - best);
+            if (len < bestLen || (len == bestLen && dist < bestDist)) {
+                best = split;
+                bestLen = len;
+            }
+        }
+        for (size_t split = 1; best == SIZE_MAX && split < n; split++) {
+            if (fitsBoth(split)) best = split;
+        }
+        if (best == SIZE_MAX) throw std::runtime_error("leaf split found no boundary that fits both pages");
+
+        VarNode *right = newNode(NodeType::Leaf);
+        std::unique_lock<std::shared_mutex> rightLock(right->node_mutex);
+        page->clear();
+        for (size_t i = 0; i < best; i++) page->insertAt(i, entries[i].first, entries[i].second);
+        for (size_t i = best; i < n; i++) right->leaf->insertAt(i - best, entries[i].first, entries[i].second);
+        right->nextLeaf = node->nextLeaf;
+        node->nextLeaf = right;
+
+        SplitResult res;
+        res.splitted = true;
+        res.separator = entries[best].first.substr(0, separatorLength(entries[best - 1].first, entries[best].first));
+        res.right = right;
+        return res;
+    }
+
+    // Length of the shortest prefix of right that still sorts after left
+    static size_t separatorLength(const std::string &left, const std::string &right) {
+        size_t l = 0;
+        size_t max = std::min(left.size(), right.size());
+        while (l < max && left[l] == right[l]) l++;
+        return std::min(l + 1, right.size());
+    }
+
+    SplitResult splitInternal(VarNode *node) {
+        VarInternalNode *internal = node->internal.get();
+        std::vector<std::string> seps = internal->separators();
+        std::vector<VarNode *> kids = internal->children;
+        size_t mid = seps.size() / 2;
+
+        VarNode *right = newNode(NodeType::Internal);
+        std::unique_lock<std::shared_mutex> rightLock(right->node_mutex);
+        right->internal->assign(std::vector<std::string>(seps.begin() + mid + 1, seps.end()),
+                                std::vector<VarNode *>(kids.begin() + mid + 1, kids.end()));
+        internal->assign(std::vector<std::string>(seps.begin(), seps.begin() + mid),
+                         std::vector<VarNode *>(kids.begin(), kids.begin() + mid + 1));
+        SplitResult res;
+        res.splitted = true;
+        res.separator = seps[mid];
+        res.right = right;
+        return res;
+    }
+
+    // ------------------------------------------------
+    // Stats helpers
+    // ------------------------------------------------
+    void collectStats(VarNode *node, int depth, Stats &st) {
+        st.depth = std::max(st.depth, depth);
+        if (node->type == NodeType::Leaf) {
+            st.leaves++;
+            st.keys += node->leaf->numSlots;
+            st.leafBytes += node->leaf->usedBytes();
+            return;
+        }
+        VarInternalNode *internal = node->internal.get();
+        st.internals++;
+        st.separators += internal->numKeys();
+        for (auto &s : internal->suffixes) {
+            st.separatorBytes += internal->prefix.size() + s.size();
+            st.suffixBytes += s.size();
+        }
+        for (VarNode *child : internal->children) collectStats(child, depth + 1, st);
+    }
+};
+
+#endif  // VARKEY_BTREE_H
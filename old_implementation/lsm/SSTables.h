@@ -1,127 +1,115 @@
 #ifndef SSTABLES_H
 #define SSTABLES_H
 
-// Assuming global.h defines KeyType, ValueType, TOMBSTONE_VALUE and ENABLE_LEARNED_INDEX
-#include "global.h" 
-#include <tbb/concurrent_hash_map.h>
-#include "RegisterBlockedBloomFilter.h"
+#include "global.h"
+#include "SplitBlockBloomFilter.h"
 
-// If ENABLE_LEARNED_INDEX is defined and is 1, include the learned index.
-// Otherwise, LearnedIndex type might not be defined.
 #if defined(ENABLE_LEARNED_INDEX) && ENABLE_LEARNED_INDEX == 1
-#include "learned_index.h" // Our new learned index header
+#include "learned_index.h"
 #endif
 
 #include <vector>
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <memory>
+#include <utility>
 
 
+// Immutable sorted run. Keys and values live in two parallel arrays ordered by key, so
+// lookups are a binary search and the table can be iterated in key order. With
+// ENABLE_LEARNED_INDEX the learned index predicts a key's position to within
+// LEARNED_INDEX_EPSILON and only that window is searched. Otherwise fences holds every
+// SSTABLE_FENCE_INTERVAL-th key; a lookup first picks the fence block (a small,
+// cache-resident array) and then searches only that block of keys.
 struct SSTable {
     uint64_t id;
     KeyType min_key;
     KeyType max_key;
-    tbb::concurrent_hash_map<KeyType, ValueType> data;
+    std::vector<KeyType> keys;
+    std::vector<ValueType> values;
     size_t entry_count;
-    RegisterBlockedBloomFilter bloom;
+    size_t tombstone_count;
+    SplitBlockBloomFilter bloom;
 
     #if defined(ENABLE_LEARNED_INDEX) && ENABLE_LEARNED_INDEX == 1
-    LearnedIndex learned_idx; // Use the new LearnedIndex class
+    LearnedIndex learned_idx;
+    #else
+    std::vector<KeyType> fences;
     #endif
 
-    SSTable(uint64_t i, KeyType min_k, KeyType max_k, tbb::concurrent_hash_map<KeyType, ValueType> d)
-        : id(i), min_key(min_k), max_key(max_k), data(std::move(d)), entry_count(data.size()),
-          bloom(512, 7)
+    // sorted_keys must be strictly increasing; sorted_values[i] belongs to sorted_keys[i]
+    SSTable(uint64_t i, std::vector<KeyType> sorted_keys, std::vector<ValueType> sorted_values,
+            double bloom_bits_per_key = SSTABLE_BLOOM_BITS_PER_KEY)
+        : id(i), min_key(sorted_keys.front()), max_key(sorted_keys.back()), keys(std::move(sorted_keys)),
+          values(std::move(sorted_values)), entry_count(keys.size()),
+          tombstone_count(std::count(values.begin(), values.end(), TOMBSTONE_VALUE)),
+          bloom(entry_count, bloom_bits_per_key)
     {
-        for (auto it = data.begin(); it != data.end(); ++it) {
-            bloom.Insert(it->first);
+        for (const auto& k : keys) {
+            bloom.Insert(k);
         }
 
         #if defined(ENABLE_LEARNED_INDEX) && ENABLE_LEARNED_INDEX == 1
-        if (entry_count > 0) {
-            std::vector<KeyType> sorted_keys;
-            sorted_keys.reserve(entry_count);
-            for (const auto& pair : data) {
-                sorted_keys.push_back(pair.first);
-            }
-            std::sort(sorted_keys.begin(), sorted_keys.end());
-            learned_idx.train(sorted_keys);
+        learned_idx.train(keys);
+        #else
+        fences.reserve(entry_count / SSTABLE_FENCE_INTERVAL + 1);
+        for (size_t pos = 0; pos < entry_count; pos += SSTABLE_FENCE_INTERVAL) {
+            fences.push_back(keys[pos]);
         }
         #endif
     }
 
     ~SSTable() = default;
-    
+
     SSTable(const SSTable&) = delete;
     SSTable& operator=(const SSTable&) = delete;
     SSTable(SSTable&&) = default;
     SSTable& operator=(SSTable&&) = default;
 
-    bool find_key(KeyType key, ValueType& value) const {
-        if (key < min_key || key > max_key) return false;
-
+    // Position of the first key >= key (entry_count if there is none)
+    size_t lower_bound_index(KeyType key) const {
         #if defined(ENABLE_LEARNED_INDEX) && ENABLE_LEARNED_INDEX == 1
-        if (learned_idx.is_trained() && entry_count > 0) {
-            // Only use LI if key is within the range of keys the model was trained on.
-            if (key >= learned_idx.get_min_training_key() && key <= learned_idx.get_max_training_key()) {
-                int estimated_min_idx, estimated_max_idx;
-                if (learned_idx.predict_index_range(key, estimated_min_idx, estimated_max_idx)) {
-                    if (estimated_min_idx > estimated_max_idx) { // Predicted range is empty
-                        #ifdef LEARNED_INDEX_AGGRESSIVE_FILTERING
-                        return false; 
-                        #endif
-                    }
-                }
-            }
-            // If key is outside learned_idx training range (but within SSTable min/max),
-            // or if prediction fails, we just proceed without LI filtering.
-        }
+        return learned_idx.lower_bound(keys.data(), key);
+        #else
+        auto fence_it = std::upper_bound(fences.begin(), fences.end(), key);
+        if (fence_it == fences.begin()) return 0;
+        size_t block_start = (fence_it - fences.begin() - 1) * SSTABLE_FENCE_INTERVAL;
+        size_t block_end = std::min(block_start + SSTABLE_FENCE_INTERVAL, entry_count);
+        return std::lower_bound(keys.begin() + block_start, keys.begin() + block_end, key) - keys.begin();
         #endif
+    }
 
+    bool find_key(KeyType key, ValueType& value) const {
+        if (key < min_key || key > max_key) return false;
         if (!bloom.Query(key)) return false;
 
-        tbb::concurrent_hash_map<KeyType, ValueType>::const_accessor acc;
-        if (data.find(acc, key)) {
-            if (acc->second == TOMBSTONE_VALUE) {
-                return false;
-            }
-            value = acc->second;
-            return true;
-        }
-        return false;
+        // A tombstone is returned as TOMBSTONE_VALUE so the caller stops searching
+        // older tables
+        size_t pos = lower_bound_index(key);
+        if (pos == entry_count || keys[pos] != key) return false;
+        value = values[pos];
+        return true;
     }
 
-    template <typename MapType>
-    static std::shared_ptr<SSTable> create_from_memtable(
-        const MapType& memtable_data_to_copy,
-        uint64_t sstable_id) {
-        if (memtable_data_to_copy.empty()) return nullptr;
-
-        tbb::concurrent_hash_map<KeyType, ValueType> tbbmap;
-        KeyType min_k = std::numeric_limits<KeyType>::max(); // Initialize properly
-        KeyType max_k = std::numeric_limits<KeyType>::min(); // Initialize properly
-        bool first_key = true;
-
-        for (const auto& kv : memtable_data_to_copy) {
-            typename tbb::concurrent_hash_map<KeyType, ValueType>::accessor acc_tbb;
-            tbbmap.insert(acc_tbb, kv.first);
-            acc_tbb->second = kv.second;
-            
-            if (first_key) {
-                min_k = kv.first;
-                max_k = kv.first;
-                first_key = false;
-            } else {
-                min_k = std::min(min_k, kv.first);
-                max_k = std::max(max_k, kv.first);
-            }
+    // Builds a table from entries already sorted by key without duplicates
+    static std::shared_ptr<SSTable> create_from_sorted(
+        std::vector<std::pair<KeyType, ValueType>> sorted_entries,
+        uint64_t sstable_id,
+        double bloom_bits_per_key = SSTABLE_BLOOM_BITS_PER_KEY) {
+        if (sorted_entries.empty()) return nullptr;
+
+        std::vector<KeyType> sorted_keys;
+        std::vector<ValueType> sorted_values;
+        sorted_keys.reserve(sorted_entries.size());
+        sorted_values.reserve(sorted_entries.size());
+        for (auto& kv : sorted_entries) {
+            sorted_keys.push_back(kv.first);
+            sorted_values.push_back(std::move(kv.second));
         }
-        
-        if (tbbmap.empty()) return nullptr;
-
-        return std::make_shared<SSTable>(sstable_id, min_k, max_k, std::move(tbbmap));
+        return std::make_shared<SSTable>(sstable_id, std::move(sorted_keys), std::move(sorted_values),
+                                         bloom_bits_per_key);
     }
 };
 
-#endif // SSTABLES_H
\ No newline at end of file
+#endif // SSTABLES_H
@@ -0,0 +1,93 @@
+#ifndef SPLIT_BLOCK_BLOOM_FILTER_H
+#define SPLIT_BLOCK_BLOOM_FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Split-block Bloom filter (as in Parquet and Impala). Each key maps to one 256-bit
+// block; the block is eight 32-bit lanes and the key sets exactly one bit in every lane.
+// A probe therefore touches a single cache line, and with AVX2 it is one multiply, one
+// shift and one test. Sized in bits per key, so small tables get small filters.
+class SplitBlockBloomFilter {
+public:
+    // Filter for about num_keys keys at bits_per_key bits each (at least one block)
+    SplitBlockBloomFilter(size_t num_keys, double bits_per_key)
+        : blocks_(std::max<size_t>(1, static_cast<size_t>(std::ceil(num_keys * std::max(bits_per_key, 0.0) / 256.0)))),
+          bits_per_key_(bits_per_key) {}
+
+    void Insert(uint64_t key) {
+        uint64_t hash = Mix(key);
+        Block& block = blocks_[BlockIndex(hash)];
+#ifdef __AVX2__
+        __m256i words = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.words));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(block.words), _mm256_or_si256(words, Mask(hash)));
+#else
+        for (int lane = 0; lane < 8; ++lane) block.words[lane] |= LaneBit(hash, lane);
+#endif
+    }
+
+    bool Query(uint64_t key) const {
+        uint64_t hash = Mix(key);
+        const Block& block = blocks_[BlockIndex(hash)];
+#ifdef __AVX2__
+        __m256i words = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.words));
+        return _mm256_testc_si256(words, Mask(hash));
+#else
+        for (int lane = 0; lane < 8; ++lane) {
+            if ((block.words[lane] & LaneBit(hash, lane)) == 0) return false;
+        }
+        return true;
+#endif
+    }
+
+    size_t SizeBytes() const { return blocks_.size() * sizeof(Block); }
+    double BitsPerKey() const { return bits_per_key_; }
+
+private:
+    struct alignas(32) Block {
+        uint32_t words[8] = {};
+    };
+
+    // Odd constants that spread the 32-bit lane hash over the lanes
+    static constexpr uint32_t SALT[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                         0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    std::vector<Block> blocks_;
+    double bits_per_key_;
+
+    // murmur3 finalizer: std::hash<uint64_t> is the identity, which clusters dense keys
+    static uint64_t Mix(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    // High half of the hash picks the block (multiply-shift instead of a modulo)
+    size_t BlockIndex(uint64_t hash) const {
+        return static_cast<size_t>(((hash >> 32) * static_cast<uint64_t>(blocks_.size())) >> 32);
+    }
+
+    // Low half of the hash picks one bit in each lane
+    static uint32_t LaneBit(uint64_t hash, int lane) {
+        return 1U << ((static_cast<uint32_t>(hash) * SALT[lane]) >> 27);
+    }
+
+#ifdef __AVX2__
+    static __m256i Mask(uint64_t hash) {
+        const __m256i salt = _mm256_setr_epi32(SALT[0], SALT[1], SALT[2], SALT[3], SALT[4], SALT[5], SALT[6], SALT[7]);
+        __m256i bit_pos = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(static_cast<uint32_t>(hash)), salt), 27);
+        return _mm256_sllv_epi32(_mm256_set1_epi32(1), bit_pos);
+    }
+#endif
+};
+
+#endif // SPLIT_BLOCK_BLOOM_FILTER_H
@@ -0,0 +1,54 @@
+#ifndef BLOOM_ALLOCATION_H
+#define BLOOM_ALLOCATION_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Runs of equal size that share one filter setting: the L0 tables, or an L1+ level
+// (a single run of level-size entries)
+struct BloomRunGroup {
+    size_t runs;
+    size_t entries_per_run;
+};
+
+// Monkey allocation (Dayan et al., SIGMOD'17) of budget_bits of filter memory over the
+// run groups. A lookup probes one filter per run, so a zero-result lookup costs the sum
+// of the runs' false-positive rates, and an existing-key lookup that cost plus one.
+// With p = exp(-bits_per_key * ln(2)^2), minimizing sum(p) under the memory budget
+// gives every run an FPR proportional to its entry count. Small, shallow runs get
+// many bits per key and the last level few. Runs whose optimal FPR would reach 1 get no
+// bits, and the rest is re-solved without them. Returns bits per key for each group.
+inline std::vector<double> monkey_bits_per_key(const std::vector<BloomRunGroup>& groups, double budget_bits) {
+    const double ln2_squared = std::log(2.0) * std::log(2.0);
+    std::vector<double> bits(groups.size(), 0.0);
+    std::vector<bool> active(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) active[g] = groups[g].runs > 0 && groups[g].entries_per_run > 0;
+
+    while (true) {
+        // FPR_g = n_g / lambda, so bits_g = ln(lambda / n_g) / ln2^2; lambda is fixed by the budget
+        double entries = 0, weighted_log = 0;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (!active[g]) continue;
+            double n = static_cast<double>(groups[g].entries_per_run);
+            entries += groups[g].runs * n;
+            weighted_log += groups[g].runs * n * std::log(n);
+        }
+        if (entries == 0) return bits;
+        double log_lambda = (budget_bits * ln2_squared + weighted_log) / entries;
+
+        bool dropped = false;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (!active[g]) continue;
+            bits[g] = (log_lambda - std::log(static_cast<double>(groups[g].entries_per_run))) / ln2_squared;
+            if (bits[g] <= 0) {
+                bits[g] = 0;
+                active[g] = false;
+                dropped = true;
+            }
+        }
+        if (!dropped) return bits;
+    }
+}
+
+#endif // BLOOM_ALLOCATION_H
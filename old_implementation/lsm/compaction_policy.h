@@ -0,0 +1,94 @@
+#ifndef COMPACTION_POLICY_H
+#define COMPACTION_POLICY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Shape of an LSMTree's levels, with the K and Z knobs of Dostoevsky's Fluid LSM tree.
+// Level i >= 1 holds at most size_ratio(i) times the entries of level i-1 and at most
+// runs_limit(i) sorted runs. A level over either limit is merged into the next one: into
+// that level's single run if it is leveled (limit 1), or as a new run if it is tiered.
+// A leveled level feeding a leveled level pushes down one table at a time instead. The
+// last level merges its own runs once it has more than Z of them.
+//   leveling:      K = 1, Z = 1   cheapest lookups, most rewriting
+//   tiering:       K = T, Z = T   cheapest writes, T runs per level to probe
+//   lazy leveling: K = T, Z = 1   tiered upper levels, one run holding most data
+struct CompactionPolicy {
+    std::vector<double> size_ratios; // T per level from L1, the last one repeating; empty: the tree's ratio
+    std::vector<size_t> max_runs;    // K per level from L1 up to the one before last, the last one repeating; empty: 1
+    size_t last_level_max_runs = 1;  // Z
+
+    double size_ratio(int level_idx, double default_ratio) const {
+        if (size_ratios.empty()) return default_ratio;
+        return size_ratios[std::min<size_t>(level_idx - 1, size_ratios.size() - 1)];
+    }
+
+    size_t runs_limit(int level_idx, int num_levels) const {
+        if (level_idx == num_levels - 1) return last_level_max_runs;
+        if (max_runs.empty()) return 1;
+        return max_runs[std::min<size_t>(level_idx - 1, max_runs.size() - 1)];
+    }
+
+    static CompactionPolicy leveling(double ratio) { return {{ratio}, {1}, 1}; }
+    static CompactionPolicy tiering(double ratio) { return {{ratio}, {runs_for(ratio)}, runs_for(ratio)}; }
+    static CompactionPolicy lazy_leveling(double ratio) { return {{ratio}, {runs_for(ratio)}, 1}; }
+
+    // "leveling", "tiering", "lazy-leveling", or custom knobs such as "K=4:4:1,Z=1,T=10:8"
+    // (per-level lists separated by ':', the last value repeating). ratio is the default T.
+    static CompactionPolicy parse(const std::string& spec, double ratio) {
+        if (spec.empty() || spec == "leveling") return leveling(ratio);
+        if (spec == "tiering") return tiering(ratio);
+        if (spec == "lazy-leveling") return lazy_leveling(ratio);
+
+        CompactionPolicy policy = leveling(ratio);
+        std::stringstream fields(spec);
+        std::string field;
+        while (std::getline(fields, field, ',')) {
+            size_t eq = field.find('=');
+            if (eq == std::string::npos) throw std::runtime_error("bad compaction policy field: " + field);
+            std::string name = field.substr(0, eq);
+            std::vector<double> values;
+            std::stringstream list(field.substr(eq + 1));
+            std::string value;
+            while (std::getline(list, value, ':')) {
+                try {
+                    values.push_back(std::stod(value));
+                } catch (const std::exception&) {
+                    throw std::runtime_error("bad compaction policy value: " + field);
+                }
+                if (values.back() < 1) throw std::runtime_error("compaction policy values must be >= 1: " + field);
+            }
+            if (values.empty()) throw std::runtime_error("bad compaction policy field: " + field);
+            if (name == "T") {
+                policy.size_ratios = values;
+            } else if (name == "K") {
+                policy.max_runs.clear();
+                for (double v : values) policy.max_runs.push_back(static_cast<size_t>(v));
+            } else if (name == "Z") {
+                policy.last_level_max_runs = static_cast<size_t>(values[0]);
+            } else {
+                throw std::runtime_error("unknown compaction policy knob: " + name);
+            }
+        }
+        return policy;
+    }
+
+    std::string describe(int num_levels, double default_ratio) const {
+        std::ostringstream out;
+        for (int i = 1; i < num_levels; ++i) {
+            out << (i > 1 ? " " : "") << "L" << i << "(T=" << size_ratio(i, default_ratio)
+                << ",runs<=" << runs_limit(i, num_levels) << ")";
+        }
+        return out.str();
+    }
+
+private:
+    static size_t runs_for(double ratio) { return std::max<size_t>(2, static_cast<size_t>(std::lround(ratio))); }
+};
+
+#endif // COMPACTION_POLICY_H
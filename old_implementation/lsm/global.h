@@ -5,10 +5,11 @@
 #include <string>
 #include <cstdint>
 
-#define ENABLE_LEARNED_INDEX 0
-constexpr size_t LEARNED_INDEX_TARGET_KEYS_PER_SEGMENT = 256;
-constexpr size_t LEARNED_INDEX_MIN_KEYS_FOR_MULTISEGMENT = LEARNED_INDEX_TARGET_KEYS_PER_SEGMENT * 2;
-constexpr size_t LEARNED_INDEX_MIN_KEYS_PER_SEGMENT_TRAINING = 5; // Increased for more stability
+#define ENABLE_LEARNED_INDEX 1 // SSTable lookups use the learned index instead of fence pointers
+constexpr size_t LEARNED_INDEX_EPSILON = 16; // Max distance of a predicted position from the real one
+constexpr size_t SSTABLE_FENCE_INTERVAL = 64; // Keys per fence pointer block in an SSTable
+constexpr double SSTABLE_BLOOM_BITS_PER_KEY = 10.0; // Bloom filter memory per key (~1% false positives), averaged over the tree
+#define ENABLE_MONKEY_BLOOM_ALLOCATION 1 // Spread the filter memory over the levels by size instead of uniformly
 
 
 
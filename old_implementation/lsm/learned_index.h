@@ -1,56 +1,65 @@
 #ifndef LEARNED_INDEX_H
 #define LEARNED_INDEX_H
 
-#include <vector>
-#include <string> // For KeyType if it's string, adjust as needed
-#include <cstdint> // For uint64_t if KeyType is numeric
-
-// Assuming KeyType is defined globally (e.g., in your "global.h" or similar)
-// If not, you might need to include that header or define KeyType here.
-// For example:
-// #include "global.h"
-using KeyType = uint64_t; // Placeholder: Replace with your actual KeyType
+#include "global.h"
 
-#include "global.h" // Include our new config file
+#include <algorithm>
+#include <cstddef>
+#include <vector>
 
+// Piecewise linear model of key -> position over a sorted key array, in the style of
+// the PGM index. Each segment predicts the position of every key it covers to within
+// LEARNED_INDEX_EPSILON, so a lookup evaluates one segment and then searches only
+// the window [pos - eps, pos + eps] of the key array. Segments are fitted greedily
+// with a shrinking cone during SSTable construction. Slopes are never negative, so
+// the window also contains the lower bound of keys that are absent.
 class LearnedIndex {
-private:
-    struct SegmentModel {
-        KeyType first_key;          // The first key this model is responsible for (inclusive).
-        double slope;
-        double intercept;
-        double max_abs_error;       // Max absolute error for this segment's model.
-        size_t start_index_global;  // The global index in the original sorted_keys array that corresponds to this segment's first_key.
-        size_t num_keys_in_segment; // Number of keys this segment was trained on.
-
-        SegmentModel(KeyType fk, double s, double i, double mae, size_t sig, size_t nk)
-            : first_key(fk), slope(s), intercept(i), max_abs_error(mae), start_index_global(sig), num_keys_in_segment(nk) {}
-    };
+public:
+    // sorted_keys must be strictly increasing; epsilon must be at least 1
+    void train(const std::vector<KeyType>& sorted_keys, size_t epsilon = LEARNED_INDEX_EPSILON);
 
-    std::vector<SegmentModel> segments_;
-    bool model_trained_ = false;
-    KeyType min_overall_key_;
-    KeyType max_overall_key_;
-    size_t total_keys_trained_on_ = 0;
+    // Position of the first key >= key; keys must be the array the index was trained on
+    size_t lower_bound(const KeyType* keys, KeyType key) const {
+        if (first_keys_.empty() || key <= first_keys_.front()) return 0;
+        size_t s = std::upper_bound(first_keys_.begin(), first_keys_.end(), key) - first_keys_.begin() - 1;
+        const Segment& seg = segments_[s];
 
-    // Helper for training individual segments
-    static bool train_linear_model(const KeyType* keys, const size_t* global_indices, size_t num_keys,
-                                   double& out_slope, double& out_intercept, double& out_max_abs_error);
+        // Past the segment's last key the prediction is clamped to the next segment's
+        // first position, which is then the answer or within eps of it
+        double predicted = seg.start + seg.slope * static_cast<double>(key - first_keys_[s]);
+        size_t pos = predicted < seg.end ? static_cast<size_t>(predicted) : seg.end;
+        size_t lo = pos > seg.start + epsilon_ ? pos - epsilon_ : seg.start;
+        size_t hi = std::min(pos + epsilon_ + 2, seg.end);
+        return lo + branchless_lower_bound(keys + lo, hi - lo, key);
+    }
 
-public:
-    LearnedIndex();
+    size_t segment_count() const { return segments_.size(); }
+    size_t epsilon() const { return epsilon_; }
+    size_t size_bytes() const { return segments_.size() * (sizeof(Segment) + sizeof(KeyType)); }
 
-    // Trains the piecewise linear model on the provided sorted keys.
-    void train(const std::vector<KeyType>& sorted_keys);
+private:
+    struct Segment {
+        size_t start;  // position of the segment's first key
+        size_t end;    // one past its last key
+        double slope;
+    };
 
-    // Predicts the potential range of sorted indices [effective_min_idx, effective_max_idx] for the key.
-    // Returns true if a prediction can be made (even if range is empty).
-    // `total_entry_count` is the total number of entries the index was built upon.
-    bool predict_index_range(KeyType key,
-                               int& effective_min_idx, int& effective_max_idx) const;
+    std::vector<KeyType> first_keys_;  // searched on their own, so kept contiguous
+    std::vector<Segment> segments_;
+    size_t epsilon_ = LEARNED_INDEX_EPSILON;
 
-    bool is_trained() const { return model_trained_; }
-    KeyType get_min_training_key() const { return min_overall_key_; }
-    KeyType get_max_training_key() const { return max_overall_key_; }
+    // Count of keys[0, n) below key. The loop has no data-dependent branch, only a
+    // conditional move, so it runs in log2(n) steps without mispredictions.
+    static size_t branchless_lower_bound(const KeyType* keys, size_t n, KeyType key) {
+        if (n == 0) return 0;
+        const KeyType* base = keys;
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half - 1] < key ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + (*base < key);
+    }
 };
+
 #endif // LEARNED_INDEX_H
@@ -0,0 +1,96 @@
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include "global.h"
+#include "SSTables.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Slices of SSTables read in key order: the tables of one sorted run, each clamped to
+// the key range being merged. The tables themselves are read in place.
+class TableRunCursor {
+public:
+    struct Slice {
+        const SSTable* table;
+        size_t begin;
+        size_t end;
+    };
+
+    // slices must not overlap and be ordered by key; empty ones are skipped
+    explicit TableRunCursor(std::vector<Slice> slices) : slices_(std::move(slices)), slice_(0), pos_(0) {
+        skip_empty();
+    }
+
+    bool valid() const { return slice_ < slices_.size(); }
+    KeyType key() const { return slices_[slice_].table->keys[pos_]; }
+    const ValueType& value() const { return slices_[slice_].table->values[pos_]; }
+    void next() {
+        if (++pos_ == slices_[slice_].end) {
+            ++slice_;
+            skip_empty();
+        }
+    }
+
+private:
+    std::vector<Slice> slices_;
+    size_t slice_;
+    size_t pos_;
+
+    void skip_empty() {
+        while (slice_ < slices_.size() && slices_[slice_].begin == slices_[slice_].end) ++slice_;
+        if (slice_ < slices_.size()) pos_ = slices_[slice_].begin;
+    }
+};
+
+// Tournament tree of losers over k cursors ordered oldest first. The root holds the
+// winner, the input with the smallest key, where the newest input wins ties; every
+// internal node holds the input that lost the match played there. Advancing the
+// winner replays only the matches on its leaf-to-root path, log2(k) comparisons
+// against the stored losers, where a heap would compare both children per level.
+class LoserTree {
+public:
+    explicit LoserTree(std::vector<TableRunCursor> oldest_first_inputs)
+        : inputs_(std::move(oldest_first_inputs)), losers_(inputs_.size()), winner_(0) {
+        if (!inputs_.empty()) winner_ = build(1);
+    }
+
+    bool valid() const { return !inputs_.empty() && inputs_[winner_].valid(); }
+    KeyType key() const { return inputs_[winner_].key(); }
+    const ValueType& value() const { return inputs_[winner_].value(); }
+
+    void next() {
+        inputs_[winner_].next();
+        // Leaves sit at k..2k-1 and internal nodes at 1..k-1, so node n's parent is n / 2
+        for (size_t node = (winner_ + inputs_.size()) / 2; node > 0; node /= 2) {
+            if (beats(losers_[node], winner_)) std::swap(losers_[node], winner_);
+        }
+    }
+
+private:
+    std::vector<TableRunCursor> inputs_;
+    std::vector<size_t> losers_;  // losers_[0] is unused
+    size_t winner_;
+
+    bool beats(size_t a, size_t b) const {
+        if (!inputs_[a].valid()) return false;
+        if (!inputs_[b].valid()) return true;
+        KeyType ka = inputs_[a].key(), kb = inputs_[b].key();
+        return ka != kb ? ka < kb : a > b;
+    }
+
+    // Plays the matches below node and returns the winner
+    size_t build(size_t node) {
+        if (node >= inputs_.size()) return node - inputs_.size();
+        size_t left = build(2 * node), right = build(2 * node + 1);
+        if (beats(left, right)) {
+            losers_[node] = right;
+            return left;
+        }
+        losers_[node] = left;
+        return right;
+    }
+};
+
+#endif // LOSER_TREE_H
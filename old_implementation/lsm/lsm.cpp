@@ -3,6 +3,7 @@
 #include <sched.h>     // For cpu_set_t, CPU_ZERO, CPU_SET
 #include <pthread.h>   // For pthread_setaffinity_np
 
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -47,6 +48,7 @@ constexpr int NUM_EXEC_NODES = 3;    // User's original value
 constexpr int NUM_THREADS = 4;       // User's original value
 constexpr int VALUE_SIZE = 8;
 constexpr int total_runtime = 10;  // seconds
+constexpr int SCAN_LENGTH = 100;   // keys per range scan in the YCSB E mix
 
 const std::string YCSB_FILE = "/mydata/ycsb/c"; // User's original path
 std::string results_FILE = "c.csv";             // Default, can be changed by arg
@@ -161,7 +163,10 @@ void worker_main(int thread_id, LSMTree* tree,
         zipf_write_ratio = 0.05;
     } else if (results_FILE == "c.csv") { // YCSB C (100% Read)
         zipf_write_ratio = 0.0;
+    } else if (results_FILE == "e.csv") { // YCSB E (95/5 Scan/Insert), scans counted as reads
+        zipf_write_ratio = 0.05;
     }
+    const bool scan_reads = results_FILE == "e.csv";
     // Add more YCSB profiles if needed e.g. D (read latest), F (read-modify-write)
 
     ScrambledZipfianGenerator zipf(TOTAL_KEYS, ZIPF_CONST, zipf_write_ratio);
@@ -178,7 +183,11 @@ void worker_main(int thread_id, LSMTree* tree,
 
         if (op == 'R') {
             t1 = __rdtscp(&tsc_aux);
-            /*bool found =*/ tree->get(key, val_buffer); // found status can be logged if needed
+            if (scan_reads) {
+                tree->scan(key, key + SCAN_LENGTH - 1, SCAN_LENGTH);
+            } else {
+                /*bool found =*/ tree->get(key, val_buffer); // found status can be logged if needed
+            }
             t2 = __rdtscp(&tsc_aux);
             local_read_latencies.push_back(cycles_to_nanoseconds(t2 - t1, CPU_FREQ_GHZ));
             num_local_reads++;
@@ -323,7 +332,14 @@ int main(int argc, char* argv[]) {
 
     try {
         // Configure In-Memory LSM Tree: memtable_entries, L0_max_SSTs, num_levels, level_ratio, sst_target_entries
-        LSMTree tree(256 * 1024, 8, 5, 10.0, 1024 * 16); 
+        // MEMTABLE=hash selects the unordered tbb memtable instead of the skiplist
+        const char* memtable_env = std::getenv("MEMTABLE");
+        MemTableType memtable_type = (memtable_env && std::string(memtable_env) == "hash") ? MemTableType::Hash
+                                                                                          : MemTableType::SkipList;
+        // COMPACTION_POLICY=leveling|tiering|lazy-leveling, or knobs such as "K=4:4:1,Z=1,T=10"
+        const char* policy_env = std::getenv("COMPACTION_POLICY");
+        CompactionPolicy compaction_policy = CompactionPolicy::parse(policy_env ? policy_env : "", 10.0);
+        LSMTree tree(256 * 1024, 8, 5, 10.0, 1024 * 16, memtable_type, 0, compaction_policy);
         
         std::cout << "Generating and inserting " << TOTAL_KEYS << " initial key/value pairs..." << std::endl;
         auto initial_fill_data = generate_initial_data(TOTAL_KEYS);
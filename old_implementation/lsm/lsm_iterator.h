@@ -0,0 +1,155 @@
+#ifndef LSM_ITERATOR_H
+#define LSM_ITERATOR_H
+
+#include "global.h"
+#include "SSTables.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// One key-ordered input of a MergingIterator. Entries are raw: tombstones are
+// returned like any other value and resolved by the merge.
+class SortedRun {
+public:
+    virtual ~SortedRun() = default;
+    // Positions the run at its first entry with key >= key
+    virtual void seek(KeyType key) = 0;
+    virtual bool valid() const = 0;
+    virtual KeyType key() const = 0;
+    virtual const ValueType& value() const = 0;
+    virtual void next() = 0;
+};
+
+// Sorted copy of (part of) a memtable
+class EntryVectorRun : public SortedRun {
+public:
+    explicit EntryVectorRun(std::vector<std::pair<KeyType, ValueType>> sorted_entries)
+        : entries_(std::move(sorted_entries)), pos_(entries_.size()) {}
+
+    void seek(KeyType key) override {
+        pos_ = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                [](const auto& kv, KeyType k) { return kv.first < k; }) - entries_.begin();
+    }
+    bool valid() const override { return pos_ < entries_.size(); }
+    KeyType key() const override { return entries_[pos_].first; }
+    const ValueType& value() const override { return entries_[pos_].second; }
+    void next() override { ++pos_; }
+
+private:
+    std::vector<std::pair<KeyType, ValueType>> entries_;
+    size_t pos_;
+};
+
+// A single SSTable, or a whole L1+ level read as one run: the tables must not overlap
+// and be ordered by min_key. Holding the shared_ptrs keeps the tables alive if a
+// compaction replaces them while the iterator is open.
+class SSTableRun : public SortedRun {
+public:
+    explicit SSTableRun(std::vector<std::shared_ptr<SSTable>> tables)
+        : tables_(std::move(tables)), table_(tables_.size()), pos_(0) {}
+
+    void seek(KeyType key) override {
+        table_ = std::lower_bound(tables_.begin(), tables_.end(), key,
+                                  [](const auto& sst, KeyType k) { return sst->max_key < k; }) - tables_.begin();
+        pos_ = table_ < tables_.size() ? tables_[table_]->lower_bound_index(key) : 0;
+    }
+    bool valid() const override { return table_ < tables_.size(); }
+    KeyType key() const override { return tables_[table_]->keys[pos_]; }
+    const ValueType& value() const override { return tables_[table_]->values[pos_]; }
+    void next() override {
+        if (++pos_ == tables_[table_]->entry_count) {
+            ++table_;
+            pos_ = 0;
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<SSTable>> tables_;
+    size_t table_;
+    size_t pos_;
+};
+
+// Merges runs ordered newest first. When several runs hold the same key only the
+// newest entry is visible; keys whose newest entry is a tombstone are skipped. The
+// runs are combined with a binary min-heap keyed on (key, run index), so each step
+// costs O(log runs) and nothing beyond the runs themselves is materialized.
+class MergingIterator {
+public:
+    explicit MergingIterator(std::vector<std::unique_ptr<SortedRun>> newest_first_runs)
+        : runs_(std::move(newest_first_runs)), current_(NO_RUN) {}
+
+    void seek(KeyType key) {
+        heap_.clear();
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            runs_[i]->seek(key);
+            if (runs_[i]->valid()) heap_.push_back(i);
+        }
+        std::make_heap(heap_.begin(), heap_.end(), HeapOrder{this});
+        settle();
+    }
+
+    void seek_to_first() { seek(std::numeric_limits<KeyType>::min()); }
+
+    bool valid() const { return current_ != NO_RUN; }
+    KeyType key() const { return runs_[current_]->key(); }
+    const ValueType& value() const { return runs_[current_]->value(); }
+
+    void next() {
+        advance(current_);
+        settle();
+    }
+
+private:
+    static constexpr size_t NO_RUN = std::numeric_limits<size_t>::max();
+
+    // std heap functions build a max-heap, so "less" means "comes out later"
+    struct HeapOrder {
+        const MergingIterator* it;
+        bool operator()(size_t a, size_t b) const {
+            KeyType ka = it->runs_[a]->key(), kb = it->runs_[b]->key();
+            return ka != kb ? ka > kb : a > b;
+        }
+    };
+
+    std::vector<std::unique_ptr<SortedRun>> runs_;
+    std::vector<size_t> heap_;  // indices of valid runs not positioned on the current entry
+    size_t current_;
+
+    size_t pop() {
+        std::pop_heap(heap_.begin(), heap_.end(), HeapOrder{this});
+        size_t run = heap_.back();
+        heap_.pop_back();
+        return run;
+    }
+
+    void advance(size_t run) {
+        runs_[run]->next();
+        if (runs_[run]->valid()) {
+            heap_.push_back(run);
+            std::push_heap(heap_.begin(), heap_.end(), HeapOrder{this});
+        }
+    }
+
+    // Moves to the smallest key whose newest version is live, discarding the older
+    // versions of every key passed over
+    void settle() {
+        while (!heap_.empty()) {
+            size_t newest = pop();
+            KeyType k = runs_[newest]->key();
+            while (!heap_.empty() && runs_[heap_.front()]->key() == k) {
+                advance(pop());
+            }
+            if (runs_[newest]->value() != TOMBSTONE_VALUE) {
+                current_ = newest;
+                return;
+            }
+            advance(newest);
+        }
+        current_ = NO_RUN;
+    }
+};
+
+#endif // LSM_ITERATOR_H
@@ -3,8 +3,42 @@
 
 #include "global.h"
 #include "SSTables.h"
-#include <tbb/concurrent_hash_map.h>
+#include "lsm_iterator.h"
+#include "memtable.h"
+#include "skiplist_memtable.h"
+#include "bloom_allocation.h"
+#include "compaction_policy.h"
+#include "loser_tree.h"
+#include "write_controller.h"
+#include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <condition_variable>
+#include <chrono>
+
+// Shards of the active-memtable pin counters; threads are spread over them round robin
+constexpr size_t MEMTABLE_PIN_SLOTS = 64;
+// Memtables flushed at once. Their L0 tables are built in parallel and installed in the
+// order the memtables were sealed.
+constexpr size_t LSM_FLUSH_WORKERS = 2;
+// Compaction jobs that may run at once; concurrent jobs work on disjoint level pairs
+constexpr size_t LSM_COMPACTION_WORKERS = 2;
+// Threads merging the key ranges (subcompactions) of a compaction job in parallel
+constexpr size_t LSM_SUBCOMPACTION_THREADS = 4;
+// Share of tombstones at which an L1+ table is pushed down ahead of the round-robin order
+constexpr double LSM_TOMBSTONE_COMPACTION_RATIO = 0.25;
+// Write stalls. Between the slowdown and the stop limit puts are paced by a token bucket
+// whose rate falls linearly from LSM_DELAYED_WRITE_RATE towards
+// LSM_MIN_DELAYED_WRITE_RATE; at the stop limit they wait until flushes or L0
+// compaction catch up. L0 limits are multiples of l0_max_sstables.
+constexpr size_t LSM_SLOWDOWN_IMMUTABLE_MEMTABLES = 2;
+constexpr size_t LSM_STOP_IMMUTABLE_MEMTABLES = 4;
+constexpr double LSM_L0_SLOWDOWN_FACTOR = 2.0;
+constexpr double LSM_L0_STOP_FACTOR = 4.0;
+constexpr double LSM_DELAYED_WRITE_RATE = 256 * 1024; // puts per second
+constexpr double LSM_MIN_DELAYED_WRITE_RATE = 16 * 1024;
+// Owed delays shorter than this are carried as token debt rather than slept
+constexpr std::chrono::microseconds LSM_MIN_WRITE_DELAY{100};
 
 class LSMTree {
 public:
@@ -12,124 +46,148 @@ public:
             size_t l0_max_sstables = 4,
             int num_levels = 4,
             double level_size_ratio = 10.0,     // Max entries in L_i+1 = ratio * Max entries in L_i
-            size_t sstable_target_entries = 256) // Target entries per SSTable during compaction
-        : active_memtable_(std::make_unique<MemTable>()),
+            size_t sstable_target_entries = 256, // Target entries per SSTable during compaction
+            MemTableType memtable_type = MemTableType::SkipList,
+            size_t bloom_memory_budget_bytes = 0, // 0: SSTABLE_BLOOM_BITS_PER_KEY per entry
+            CompactionPolicy compaction_policy = CompactionPolicy()) // Default: leveling at level_size_ratio
+        : memtable_type_(memtable_type),
+          active_memtable_(make_memtable(memtable_type)),
+          bloom_memory_budget_bytes_(bloom_memory_budget_bytes),
           next_sstable_id_(0),
-          shutdown_requested_(false),
           memtable_max_size_entries_(memtable_max_entries),
           max_level0_sstables_(l0_max_sstables),
           max_levels_(num_levels),
           level_entry_multiplier_(level_size_ratio),
-          sstable_target_entry_count_(sstable_target_entries) {
+          sstable_target_entry_count_(sstable_target_entries),
+          compaction_policy_(std::move(compaction_policy)),
+          shutdown_requested_(false),
+          subcompaction_arena_(static_cast<int>(
+              std::min<size_t>(LSM_SUBCOMPACTION_THREADS, std::max(1u, std::thread::hardware_concurrency())))),
+          l0_slowdown_runs_(static_cast<size_t>(l0_max_sstables * LSM_L0_SLOWDOWN_FACTOR)),
+          l0_stop_runs_(std::max(l0_slowdown_runs_ + 1, static_cast<size_t>(l0_max_sstables * LSM_L0_STOP_FACTOR))),
+          write_controller_(LSM_DELAYED_WRITE_RATE * std::chrono::duration<double>(LSM_MIN_WRITE_DELAY).count()) {
 
         levels_.resize(max_levels_);
+        level_bloom_bits_per_key_.assign(max_levels_, SSTABLE_BLOOM_BITS_PER_KEY);
+        level_compacting_.assign(max_levels_, false);
+        compaction_cursor_.assign(max_levels_, 0);
+        active_memtable_raw_.store(active_memtable_.get());
         // No disk loading or directory creation needed
 
         shutdown_requested_ = false;
-        flush_worker_thread_ = std::thread(&LSMTree::flush_worker_loop, this);
-        compaction_worker_thread_ = std::thread(&LSMTree::compaction_worker_loop, this);
+        for (size_t w = 0; w < LSM_FLUSH_WORKERS; ++w) {
+            flush_worker_threads_.emplace_back(&LSMTree::flush_worker_loop, this);
+        }
+        for (size_t w = 0; w < LSM_COMPACTION_WORKERS; ++w) {
+            compaction_worker_threads_.emplace_back(&LSMTree::compaction_worker_loop, this);
+        }
     }
 
     ~LSMTree() {
         shutdown_requested_ = true;
-        immutable_memtables_cv_.notify_all();
+        { std::lock_guard<std::mutex> lock(compaction_mutex_); }
         compaction_cv_.notify_all();
+        notify_stalled_writers();
 
-        if (flush_worker_thread_.joinable()) {
-            flush_worker_thread_.join();
+        // Workers drain the memtables queued ahead of their stop marker
+        for (size_t w = 0; w < flush_worker_threads_.size(); ++w) flush_queue_.push(FlushJob{0, nullptr});
+        for (auto& worker : flush_worker_threads_) {
+            if (worker.joinable()) worker.join();
         }
-        if (compaction_worker_thread_.joinable()) {
-            compaction_worker_thread_.join();
+        for (auto& worker : compaction_worker_threads_) {
+            if (worker.joinable()) worker.join();
         }
         
-        // Final flush of active and immutable memtables (to L0 in-memory SSTables)
+        // Final flush of the active memtable (to an L0 in-memory SSTable)
         if (active_memtable_ && !active_memtable_->empty()) {
-            std::lock_guard<std::mutex> lock(immutable_memtables_mutex_);
-            immutable_memtables_.push_back(std::move(active_memtable_));
-        }
-        active_memtable_ = nullptr;
-
-        while (true) {
-            std::unique_ptr<MemTable> memtable_to_flush;
+            FlushJob job{0, active_memtable_};
             {
                 std::lock_guard<std::mutex> lock(immutable_memtables_mutex_);
-                if (immutable_memtables_.empty()) break;
-                memtable_to_flush = std::move(immutable_memtables_.front());
-                immutable_memtables_.erase(immutable_memtables_.begin());
-            }
-            if (memtable_to_flush) {
-                flush_memtable_to_l0(std::move(memtable_to_flush));
+                job.seq = next_flush_seq_++;
+                immutable_memtables_.push_back(active_memtable_);
+                immutable_memtable_count_ = immutable_memtables_.size();
             }
+            flush_memtable_to_l0(std::move(job));
         }
+        active_memtable_ = nullptr;
+        active_memtable_raw_.store(nullptr);
     }
 
     bool get(KeyType key, ValueType& value) {
         // 1. Check active memtable
-        if (active_memtable_) {
-            MemTable::const_accessor acc;
-            if (active_memtable_->find(acc, key)) {
-                if (acc->second == TOMBSTONE_VALUE) return false;
-                value = acc->second;
-                return true;
-            }
+        {
+            ActiveMemTablePin active(*this);
+            if (active->get(key, value)) return value != TOMBSTONE_VALUE;
         }
         // 2. Check immutable memtables (newest to oldest)
         {
             std::lock_guard<std::mutex> lock(immutable_memtables_mutex_);
             for (auto it = immutable_memtables_.rbegin(); it != immutable_memtables_.rend(); ++it) {
-                auto const& mt = *it;
-                MemTable::const_accessor acc;
-                if (mt->find(acc, key)) {
-                    if (acc->second == TOMBSTONE_VALUE) return false;
-                    value = acc->second;
-                    return true;
-                }
+                if ((*it)->get(key, value)) return value != TOMBSTONE_VALUE;
             }
         }
 
-        // 3. Check SSTables (L0 newest first, then L1 to Ln)
+        // 3. Check SSTables, level by level and within a level newest run first. A run
+        // has at most one table whose range holds the key; every L0 table is a run.
         std::shared_lock<std::shared_mutex> levels_lock(levels_metadata_mutex_);
-        if (!levels_.empty()) { // L0
-            const auto& level0_sstables = levels_[0];
-            for (auto sst_it = level0_sstables.rbegin(); sst_it != level0_sstables.rend(); ++sst_it) {
-                std::shared_ptr<SSTable> sstable = *sst_it; // Ensure local shared_ptr copy
-                if (key >= sstable->min_key && key <= sstable->max_key) {
-                    if (sstable->find_key(key, value)) return true;
-                }
+        for (const auto& level : levels_) {
+            for (auto run = level.rbegin(); run != level.rend(); ++run) {
+                const SSTable* sstable = run->find_table(key); // levels_lock keeps it alive
+                if (sstable && sstable->find_key(key, value)) return value != TOMBSTONE_VALUE;
             }
         }
+        return false;
+    }
 
-        for (size_t i = 1; i < levels_.size(); ++i) { // L1+
-            const auto& current_level_sstables = levels_[i];
-            for (const auto& sstable_ptr : current_level_sstables) { // L1+ SSTables are non-overlapping by min_key
-                std::shared_ptr<SSTable> sstable = sstable_ptr; // Ensure local shared_ptr copy
-                if (key >= sstable->min_key && key <= sstable->max_key) { // Range check first
-                    if (sstable->find_key(key, value)) return true;
-                    // If non-overlapping and sorted by min_key, can break early if sstable->min_key > key
-                } else if (sstable->min_key > key && !current_level_sstables.empty() && sstable == current_level_sstables.front()){
-                    // Optimization for sorted, non-overlapping levels: if key is smaller than the first sstable's min_key
-                } else if (sstable->min_key > key) { // If level sorted by min_key & non-overlapping
-                     break; // Key cannot be in subsequent SSTables of this level
+    // Iterator over the sources present at the time of the call, merged newest first.
+    // SSTables and skiplist memtables are read in place; a hash memtable copies and
+    // sorts its entries in [lo, hi] up front, so seeks outside [lo, hi] may miss its data.
+    MergingIterator new_iterator(KeyType lo = std::numeric_limits<KeyType>::min(),
+                                 KeyType hi = std::numeric_limits<KeyType>::max()) {
+        std::vector<std::unique_ptr<SortedRun>> runs;
+        {
+            ActiveMemTablePin active(*this);
+            runs.push_back(active->new_run(lo, hi));
+        }
+        {
+            std::lock_guard<std::mutex> lock(immutable_memtables_mutex_);
+            for (auto it = immutable_memtables_.rbegin(); it != immutable_memtables_.rend(); ++it) {
+                runs.push_back((*it)->new_run(lo, hi));
+            }
+        }
+        {
+            std::shared_lock<std::shared_mutex> levels_lock(levels_metadata_mutex_);
+            for (const auto& level : levels_) {
+                for (auto run = level.rbegin(); run != level.rend(); ++run) {
+                    runs.push_back(std::make_unique<SSTableRun>(run->tables));
                 }
             }
         }
-        return false;
+        return MergingIterator(std::move(runs));
     }
 
-    void put(KeyType key, const ValueType& value) {
-        std::unique_lock<std::shared_mutex> lock(active_memtable_mutex_);
-        if (!active_memtable_) {
-            active_memtable_ = std::make_unique<MemTable>();
+    // Live entries with lo <= key <= hi in key order, at most max_results of them
+    std::vector<std::pair<KeyType, ValueType>> scan(KeyType lo, KeyType hi,
+                                                    size_t max_results = std::numeric_limits<size_t>::max()) {
+        std::vector<std::pair<KeyType, ValueType>> out;
+        if (lo > hi) return out;
+        MergingIterator it = new_iterator(lo, hi);
+        for (it.seek(lo); it.valid() && it.key() <= hi && out.size() < max_results; it.next()) {
+            out.emplace_back(it.key(), it.value());
         }
+        return out;
+    }
+
+    void put(KeyType key, const ValueType& value) {
+        if (write_pressure() >= 0) throttle_write();
+        MemTable* written;
         {
-            MemTable::accessor acc;
-            active_memtable_->insert(acc, key);
-            acc->second = value;
-        }
-        if (active_memtable_->size() >= memtable_max_size_entries_) {
-            lock.unlock(); // Unlock before calling schedule_flush_active_memtable to avoid deadlock
-            schedule_flush_active_memtable();
+            ActiveMemTablePin active(*this);
+            active->put(key, value);
+            written = active->size() >= memtable_max_size_entries_ ? active.get() : nullptr;
         }
+        // Unpinned first: the swap waits for every pin on the full memtable
+        if (written) schedule_flush_active_memtable(written);
     }
 
     void del(KeyType key) {
@@ -139,8 +197,8 @@ public:
     void print_tree_stats() {
         std::cout << "--- LSM Tree In-Memory Stats ---" << std::endl;
         {
-            std::shared_lock<std::shared_mutex> lock(active_memtable_mutex_);
-            std::cout << "Active MemTable Entries: " << (active_memtable_ ? active_memtable_->size() : 0) << "/" << memtable_max_size_entries_ << std::endl;
+            ActiveMemTablePin active(*this);
+            std::cout << "Active MemTable Entries: " << active->size() << "/" << memtable_max_size_entries_ << std::endl;
         }
         {
             std::lock_guard<std::mutex> lock(immutable_memtables_mutex_);
@@ -149,37 +207,167 @@ public:
         {
             std::shared_lock<std::shared_mutex> lock(levels_metadata_mutex_);
             std::cout << "SSTable Levels: " << levels_.size() << " (Max Configured: " << max_levels_ << ")" << std::endl;
+            std::cout << "Compaction policy: " << compaction_policy_.describe(max_levels_, level_entry_multiplier_) << std::endl;
             for (size_t i = 0; i < levels_.size(); ++i) {
-                size_t total_entries = 0;
-                for(const auto& sst : levels_[i]) {
-                    total_entries += sst->entry_count;
-                }
-                std::cout << "  Level " << i << ": " << levels_[i].size() << " SSTables, Total Entries: " << total_entries << std::endl;
+                size_t total_entries = get_level_total_entries(static_cast<int>(i));
+                size_t total_sstables = 0;
+                for (const auto& run : levels_[i]) total_sstables += run.tables.size();
+                std::cout << "  Level " << i << ": " << levels_[i].size() << " runs, " << total_sstables
+                          << " SSTables, Total Entries: " << total_entries << std::endl;
                  if (i == 0 && levels_[i].size() > max_level0_sstables_) {
                     std::cout << "    (Needs L0 compaction, max SSTables is " << max_level0_sstables_ << ")" << std::endl;
                  } else if (i > 0 && total_entries > get_max_entries_for_level(i)) { // Check L1+
                     std::cout << "    (Needs L" << i << " compaction, max entries is ~" << get_max_entries_for_level(i) << ")" << std::endl;
                  }
+                print_bloom_stats_nolock(i);
             }
         }
+        std::cout << "Write stalls: " << write_controller_.delayed_writes() << " delayed puts ("
+                  << write_controller_.delayed_ms() << " ms), " << write_controller_.stopped_writes()
+                  << " stopped puts (" << write_controller_.stopped_ms() << " ms)" << std::endl;
+        uint64_t flushes = flushes_.load();
+        if (flushes > 0) {
+            double build_s = flush_build_ns_.load() / 1e9;
+            std::cout << "Flushes: " << flushes << " memtables by " << LSM_FLUSH_WORKERS << " workers, "
+                      << build_s * 1e3 / flushes << " ms to build and " << flush_install_wait_ns_.load() / 1e6 / flushes
+                      << " ms waiting for install order per flush, "
+                      << (build_s > 0 ? flushed_entries_.load() / build_s / 1e3 : 0.0) << " K entries/s per worker" << std::endl;
+        }
+        uint64_t flushed = flushed_entries_.load();
+        std::cout << "Entries flushed: " << flushed << ", rewritten by compaction: " << compacted_entries_.load()
+                  << ", write amplification: " << (flushed ? 1.0 + static_cast<double>(compacted_entries_.load()) / flushed : 0.0)
+                  << ", trivial moves: " << trivial_moves_.load() << std::endl;
          std::cout << "Next SSTable ID: " << next_sstable_id_.load() << std::endl;
         std::cout << "--------------------------------" << std::endl;
     }
 
 private:
-    using MemTable = tbb::concurrent_hash_map<KeyType, ValueType>;
+    using MemTablePtr = std::shared_ptr<MemTable>;
     using SSTablePtr = std::shared_ptr<SSTable>;
 
-    std::unique_ptr<MemTable> active_memtable_;
-    std::shared_mutex active_memtable_mutex_;
+    // Counts operations in flight on the active memtable, split by the parity of the
+    // memtable epoch they started in
+    struct alignas(64) PinSlot {
+        std::atomic<int64_t> count[2] = {};
+    };
+
+    // Keeps the memtable that was active when it was taken from being sealed (and thus
+    // flushed and freed) until it is released. Writers and readers never block each
+    // other: a pin is a fetch_add on the calling thread's own slot.
+    class ActiveMemTablePin {
+    public:
+        explicit ActiveMemTablePin(LSMTree& tree) {
+            PinSlot& slot = tree.pin_slots_[pin_slot_index()];
+            while (true) {
+                uint64_t epoch = tree.memtable_epoch_.load();
+                counter_ = &slot.count[epoch & 1];
+                counter_->fetch_add(1);
+                // A swap that bumped the epoch meanwhile may not wait for this pin
+                if (tree.memtable_epoch_.load() == epoch) break;
+                counter_->fetch_sub(1);
+            }
+            memtable_ = tree.active_memtable_raw_.load();
+        }
+        ~ActiveMemTablePin() { counter_->fetch_sub(1, std::memory_order_release); }
+
+        ActiveMemTablePin(const ActiveMemTablePin&) = delete;
+        ActiveMemTablePin& operator=(const ActiveMemTablePin&) = delete;
+
+        MemTable* get() const { return memtable_; }
+        MemTable* operator->() const { return memtable_; }
+
+    private:
+        std::atomic<int64_t>* counter_;
+        MemTable* memtable_;
+
+        static size_t pin_slot_index() {
+            static std::atomic<size_t> next_slot{0};
+            static thread_local size_t slot = next_slot.fetch_add(1) % MEMTABLE_PIN_SLOTS;
+            return slot;
+        }
+    };
 
-    std::vector<std::unique_ptr<MemTable>> immutable_memtables_;
+    MemTableType memtable_type_;
+    MemTablePtr active_memtable_;  // owning pointer; only changed under memtable_swap_mutex_
+    std::atomic<MemTable*> active_memtable_raw_{nullptr};  // what pinned operations use
+    std::atomic<uint64_t> memtable_epoch_{0};  // incremented by every swap
+    PinSlot pin_slots_[MEMTABLE_PIN_SLOTS];
+    std::mutex memtable_swap_mutex_;
+
+    // A sealed memtable and its place in sealing order; a null memtable stops a worker
+    struct FlushJob {
+        uint64_t seq;
+        MemTablePtr memtable;
+    };
+
+    // Memtables waiting to be flushed or being flushed, oldest first; what readers search
+    std::vector<MemTablePtr> immutable_memtables_;
+    std::atomic<size_t> immutable_memtable_count_{0};  // immutable_memtables_.size(), read by put
+    uint64_t next_flush_seq_ = 0;  // guarded by immutable_memtables_mutex_
     std::mutex immutable_memtables_mutex_;
-    std::condition_variable immutable_memtables_cv_;
+    // Sealed memtables for the flush workers, in sealing order. Idle workers block on
+    // this queue instead of on immutable_memtables_mutex_.
+    tbb::concurrent_bounded_queue<FlushJob> flush_queue_;
+    // Sequence number of the next flush to install
+    uint64_t next_install_seq_ = 0;
+    std::mutex flush_install_mutex_;
+    std::condition_variable flush_install_cv_;
+
+    // One sorted run of a level: tables with disjoint key ranges, ordered by min_key.
+    // min_keys and max_keys are its fence pointers, contiguous so get() binary-searches
+    // them instead of visiting every table; refresh() rebuilds them after a change.
+    struct LevelRun {
+        std::vector<SSTablePtr> tables;
+        std::vector<KeyType> min_keys;
+        std::vector<KeyType> max_keys;
+        size_t entries = 0;
+
+        explicit LevelRun(std::vector<SSTablePtr> run_tables) : tables(std::move(run_tables)) { refresh(); }
+
+        void refresh() {
+            min_keys.clear();
+            max_keys.clear();
+            entries = 0;
+            for (const auto& sst : tables) {
+                min_keys.push_back(sst->min_key);
+                max_keys.push_back(sst->max_key);
+                entries += sst->entry_count;
+            }
+        }
 
-    std::vector<std::vector<SSTablePtr>> levels_;
+        // The one table whose range holds key, if any
+        const SSTable* find_table(KeyType key) const {
+            auto fence = std::upper_bound(min_keys.begin(), min_keys.end(), key);
+            if (fence == min_keys.begin()) return nullptr;
+            size_t pos = fence - min_keys.begin() - 1;
+            return key <= max_keys[pos] ? tables[pos].get() : nullptr;
+        }
+
+        // Tables overlapping [lo, hi]
+        std::vector<SSTablePtr> overlapping(KeyType lo, KeyType hi) const {
+            size_t begin = std::lower_bound(max_keys.begin(), max_keys.end(), lo) - max_keys.begin();
+            size_t end = std::upper_bound(min_keys.begin(), min_keys.end(), hi) - min_keys.begin();
+            return begin < end ? std::vector<SSTablePtr>(tables.begin() + begin, tables.begin() + end)
+                               : std::vector<SSTablePtr>();
+        }
+    };
+
+    // Per level, its runs oldest first. Every L0 table is a run of its own; an L1+ level
+    // has as many runs as its compaction policy allows (one when leveled).
+    std::vector<std::vector<LevelRun>> levels_;
     std::shared_mutex levels_metadata_mutex_;
 
+    // Filter bits per key for tables built into each level, from the last flush or
+    // compaction. Guarded by levels_metadata_mutex_.
+    std::vector<double> level_bloom_bits_per_key_;
+    size_t bloom_memory_budget_bytes_;
+
+    // Sorted runs in a level and the entries they hold
+    struct LevelShape {
+        size_t runs;
+        size_t entries;
+    };
+
     std::atomic<uint64_t> next_sstable_id_;
 
     size_t memtable_max_size_entries_;
@@ -187,84 +375,259 @@ private:
     int max_levels_;
     double level_entry_multiplier_;
     size_t sstable_target_entry_count_;
+    CompactionPolicy compaction_policy_;
 
-    std::thread flush_worker_thread_;
-    std::thread compaction_worker_thread_;
+    std::vector<std::thread> flush_worker_threads_;
+    std::vector<std::thread> compaction_worker_threads_;
     std::atomic<bool> shutdown_requested_;
     std::condition_variable compaction_cv_;
     std::mutex compaction_mutex_;
+    // Levels that are the source or target of a running compaction job. Guarded by
+    // levels_metadata_mutex_.
+    std::vector<bool> level_compacting_;
+    // Per level, the key after the last table pushed down; the next one starts there.
+    // Guarded by levels_metadata_mutex_.
+    std::vector<KeyType> compaction_cursor_;
+    tbb::task_arena subcompaction_arena_;
+
+    // Entries written by flushes and by compactions, for write amplification
+    std::atomic<uint64_t> flushed_entries_{0};
+    std::atomic<uint64_t> compacted_entries_{0};
+    std::atomic<uint64_t> trivial_moves_{0};
+    // Flushes, and the worker time spent building tables and waiting for their turn
+    std::atomic<uint64_t> flushes_{0};
+    std::atomic<uint64_t> flush_build_ns_{0};
+    std::atomic<uint64_t> flush_install_wait_ns_{0};
+
+    // Write stall state: L0 run count as of the last change, and the L0 limits
+    std::atomic<size_t> level0_runs_{0};
+    size_t l0_slowdown_runs_;
+    size_t l0_stop_runs_;
+    WriteController write_controller_;
+    std::mutex write_stall_mutex_;
+    std::condition_variable write_stall_cv_;
+
+
+    static MemTablePtr make_memtable(MemTableType type) {
+        if (type == MemTableType::Hash) return std::make_shared<HashMemTable>();
+        return std::make_shared<SkipListMemTable>();
+    }
 
+    // Replaces full_memtable as the active memtable. It is published to the immutable
+    // list before it leaves the active slot, so readers always find it in one of them,
+    // and becomes flushable once all operations pinned in the previous epoch are done.
+    void schedule_flush_active_memtable(MemTable* full_memtable) {
+        std::lock_guard<std::mutex> swap_lock(memtable_swap_mutex_);
+        if (active_memtable_.get() != full_memtable) return; // Another writer swapped it already
 
-    void schedule_flush_active_memtable() {
-        std::unique_ptr<MemTable> new_active = std::make_unique<MemTable>();
-        std::unique_ptr<MemTable> old_active_to_flush;
+        FlushJob job{0, active_memtable_};
         {
-            std::unique_lock<std::shared_mutex> lock(active_memtable_mutex_);
-            if (active_memtable_ && active_memtable_->size() >= memtable_max_size_entries_) {
-                old_active_to_flush = std::move(active_memtable_);
-                active_memtable_ = std::move(new_active);
-            } else {
-                return;
-            }
-        }
-        if (old_active_to_flush) {
             std::lock_guard<std::mutex> imm_lock(immutable_memtables_mutex_);
-            immutable_memtables_.push_back(std::move(old_active_to_flush));
-            immutable_memtables_cv_.notify_one();
+            job.seq = next_flush_seq_++;
+            immutable_memtables_.push_back(active_memtable_);
+            immutable_memtable_count_ = immutable_memtables_.size();
+        }
+        active_memtable_ = make_memtable(memtable_type_);
+        active_memtable_raw_.store(active_memtable_.get());
+        uint64_t old_epoch = memtable_epoch_.fetch_add(1);
+        wait_for_memtable_pins(old_epoch & 1);
+        // Still under memtable_swap_mutex_, so jobs are queued in sealing order
+        flush_queue_.push(std::move(job));
+    }
+
+    void wait_for_memtable_pins(size_t parity) {
+        while (true) {
+            int64_t pinned = 0;
+            for (const auto& slot : pin_slots_) pinned += slot.count[parity].load(std::memory_order_acquire);
+            if (pinned == 0) return;
+            std::this_thread::yield();
         }
     }
 
     void flush_worker_loop() {
-        while (!shutdown_requested_) {
-            std::unique_ptr<MemTable> memtable_to_flush;
+        while (true) {
+            FlushJob job;
+            flush_queue_.pop(job);
+            if (!job.memtable) break;
+            flush_memtable_to_l0(std::move(job));
+            { std::lock_guard<std::mutex> lock(compaction_mutex_); }
+            compaction_cv_.notify_one(); // Signal for potential L0 compaction
+        }
+    }
+    
+    // Turns a sealed memtable into an L0 SSTable. Tables are built concurrently but
+    // installed strictly in sealing order: readers search the immutable memtables before
+    // L0, so a newer table must not reach L0 while an older memtable is still listed,
+    // and L0 stays ordered oldest first. The memtable is removed from the immutable
+    // list in the same critical section that installs the table, so readers find its
+    // entries in one place or the other throughout.
+    void flush_memtable_to_l0(FlushJob job) {
+        const MemTablePtr& memtable_data_ptr = job.memtable;
+        auto build_start = std::chrono::steady_clock::now();
+        SSTablePtr new_sstable;
+        std::vector<double> bloom_plan;
+        if (memtable_data_ptr && !memtable_data_ptr->empty()) {
+            uint64_t current_sstable_id = next_sstable_id_++;
+            auto entries = memtable_data_ptr->sorted_entries();
             {
-                std::unique_lock<std::mutex> lock(immutable_memtables_mutex_);
-                immutable_memtables_cv_.wait(lock, [this] {
-                    return shutdown_requested_ || !immutable_memtables_.empty();
-                });
-
-                if (shutdown_requested_ && immutable_memtables_.empty()) break;
-                if (immutable_memtables_.empty()) continue;
-
-                memtable_to_flush = std::move(immutable_memtables_.front());
-                immutable_memtables_.erase(immutable_memtables_.begin());
+                std::shared_lock<std::shared_mutex> lock(levels_metadata_mutex_);
+                std::vector<LevelShape> shapes = level_shapes_nolock();
+                shapes[0].runs += 1;
+                shapes[0].entries += entries.size();
+                bloom_plan = plan_bloom_bits(shapes);
             }
+            // Create an in-memory SSTable from the memtable's entries in key order
+            new_sstable = SSTable::create_from_sorted(std::move(entries), current_sstable_id, bloom_plan[0]);
+        }
+        auto build_end = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> order_lock(flush_install_mutex_);
+            flush_install_cv_.wait(order_lock, [&] { return next_install_seq_ == job.seq; });
+        }
+        auto install_start = std::chrono::steady_clock::now();
 
-            if (memtable_to_flush) {
-                flush_memtable_to_l0(std::move(memtable_to_flush));
-                compaction_cv_.notify_one(); // Signal for potential L0 compaction
-            }
+        std::unique_lock<std::shared_mutex> lock(levels_metadata_mutex_);
+        if (new_sstable) {
+            level_bloom_bits_per_key_ = std::move(bloom_plan);
+            flushed_entries_ += new_sstable->entry_count;
+            levels_[0].emplace_back(std::vector<SSTablePtr>{new_sstable}); // L0 runs are oldest first
         }
+        level0_runs_ = levels_[0].size();
+        {
+            std::lock_guard<std::mutex> imm_lock(immutable_memtables_mutex_);
+            immutable_memtables_.erase(std::find(immutable_memtables_.begin(), immutable_memtables_.end(), memtable_data_ptr));
+            immutable_memtable_count_ = immutable_memtables_.size();
+        }
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> order_lock(flush_install_mutex_);
+            ++next_install_seq_;
+        }
+        flush_install_cv_.notify_all();
+        ++flushes_;
+        flush_build_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(build_end - build_start).count();
+        flush_install_wait_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(install_start - build_end).count();
+        notify_stalled_writers();
     }
-    
-    void flush_memtable_to_l0(std::unique_ptr<MemTable> memtable_data_ptr) {
-        if (!memtable_data_ptr || memtable_data_ptr->empty()) return;
 
-        uint64_t current_sstable_id = next_sstable_id_++;
-        // Create an in-memory SSTable. Pass the map data directly.
-        SSTablePtr new_sstable = SSTable::create_from_memtable(
-            *memtable_data_ptr, current_sstable_id);
+    // How far the tree is into its stall limits: below 0 while writes run freely, 0 at
+    // the slowdown limit and 1 at the stop limit, taking whichever of the immutable
+    // memtables and the L0 runs is further in
+    double write_pressure() const {
+        auto pressure = [](size_t count, size_t slowdown, size_t stop) {
+            return (static_cast<double>(count) - slowdown) / (stop - slowdown);
+        };
+        return std::max(pressure(immutable_memtable_count_.load(std::memory_order_relaxed),
+                                 LSM_SLOWDOWN_IMMUTABLE_MEMTABLES, LSM_STOP_IMMUTABLE_MEMTABLES),
+                        pressure(level0_runs_.load(std::memory_order_relaxed), l0_slowdown_runs_, l0_stop_runs_));
+    }
 
-        if (new_sstable) {
-            std::unique_lock<std::shared_mutex> lock(levels_metadata_mutex_);
-            levels_[0].push_back(new_sstable);
-            // L0 SSTables are sorted by creation time (ID) to search newest first
-            std::sort(levels_[0].begin(), levels_[0].end(), [](const SSTablePtr& a, const SSTablePtr& b) {
-                return a->id < b->id; // Older IDs (smaller) first for consistent iteration order
-            });
-        }
+    // Stops the calling writer while the tree is at a stop limit, then makes it wait for
+    // a token at a rate that shrinks as the pressure grows
+    void throttle_write() {
+        double pressure = write_pressure();
+        if (pressure >= 1.0) {
+            auto stall_start = WriteController::Clock::now();
+            {
+                std::unique_lock<std::mutex> lock(write_stall_mutex_);
+                write_stall_cv_.wait(lock, [this] { return shutdown_requested_ || write_pressure() < 1.0; });
+            }
+            write_controller_.record_stop(WriteController::Clock::now() - stall_start);
+            pressure = write_pressure();
+        }
+        if (pressure < 0) return;
+        double rate = LSM_DELAYED_WRITE_RATE - pressure * (LSM_DELAYED_WRITE_RATE - LSM_MIN_DELAYED_WRITE_RATE);
+        std::chrono::nanoseconds delay = write_controller_.reserve(std::max(rate, LSM_MIN_DELAYED_WRITE_RATE));
+        if (delay < LSM_MIN_WRITE_DELAY) return;
+        auto delay_start = WriteController::Clock::now();
+        std::this_thread::sleep_for(delay);
+        write_controller_.record_delay(WriteController::Clock::now() - delay_start);
+    }
+
+    void notify_stalled_writers() {
+        { std::lock_guard<std::mutex> lock(write_stall_mutex_); }
+        write_stall_cv_.notify_all();
     }
 
     size_t get_level_total_entries(int level_idx) const {
         // Caller must hold levels_metadata_mutex_ (shared is fine)
         size_t total_entries = 0;
         if (level_idx < 0 || level_idx >= static_cast<int>(levels_.size())) return 0;
-        for (const auto& sst : levels_[level_idx]) {
-            total_entries += sst->entry_count;
+        for (const auto& run : levels_[level_idx]) {
+            total_entries += run.entries;
         }
         return total_entries;
     }
     
+    // Caller must hold levels_metadata_mutex_ (shared is fine)
+    std::vector<LevelShape> level_shapes_nolock() const {
+        std::vector<LevelShape> shapes(levels_.size());
+        for (size_t i = 0; i < levels_.size(); ++i) {
+            shapes[i].runs = levels_[i].size();
+            shapes[i].entries = get_level_total_entries(static_cast<int>(i));
+        }
+        return shapes;
+    }
+
+    // Bits per key for each level, spending the filter memory budget on the given level
+    // sizes. Monkey gives the small upper levels more bits than the last one, which
+    // lowers the summed false-positive rate that every miss pays.
+    std::vector<double> plan_bloom_bits(const std::vector<LevelShape>& shapes) const {
+        size_t total_entries = 0;
+        for (const auto& shape : shapes) total_entries += shape.entries;
+        double budget_bits = bloom_memory_budget_bytes_ ? bloom_memory_budget_bytes_ * 8.0
+                                                        : SSTABLE_BLOOM_BITS_PER_KEY * total_entries;
+        #if defined(ENABLE_MONKEY_BLOOM_ALLOCATION) && ENABLE_MONKEY_BLOOM_ALLOCATION == 1
+        std::vector<BloomRunGroup> groups;
+        for (const auto& shape : shapes) {
+            bool has_runs = shape.runs > 0 && shape.entries > 0;
+            groups.push_back({has_runs ? shape.runs : 0, has_runs ? shape.entries / shape.runs : 0});
+        }
+        std::vector<double> bits = monkey_bits_per_key(groups, budget_bits);
+        // Empty levels get the uniform rate, for the first tables that land there
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            if (groups[i].runs == 0) bits[i] = total_entries ? budget_bits / total_entries : SSTABLE_BLOOM_BITS_PER_KEY;
+        }
+        return bits;
+        #else
+        return std::vector<double>(shapes.size(), total_entries ? budget_bits / total_entries : SSTABLE_BLOOM_BITS_PER_KEY);
+        #endif
+    }
+
+    // Probes every filter of a level with random keys the table does not hold and
+    // reports the measured false-positive rate and the cost of a probe.
+    // Caller must hold levels_metadata_mutex_ (shared is fine)
+    void print_bloom_stats_nolock(size_t level_idx) const {
+        std::vector<const SSTable*> level;
+        for (const auto& run : levels_[level_idx]) {
+            for (const auto& sst : run.tables) level.push_back(sst.get());
+        }
+        if (level.empty()) return;
+        constexpr size_t PROBES_PER_LEVEL = 1 << 16;
+        size_t probes_per_table = std::max<size_t>(64, PROBES_PER_LEVEL / level.size());
+        size_t filter_bytes = 0, total_entries = 0;
+        std::vector<std::pair<const SSTable*, KeyType>> probes;
+        uint64_t rng = 0x9e3779b97f4a7c15ULL + level_idx;
+        for (const auto& sst : level) {
+            filter_bytes += sst->bloom.SizeBytes();
+            total_entries += sst->entry_count;
+            for (size_t n = 0; n < probes_per_table; ++n) {
+                rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+                KeyType key = rng ^ (rng >> 29);
+                size_t pos = sst->lower_bound_index(key);
+                if (pos == sst->entry_count || sst->keys[pos] != key) probes.emplace_back(sst, key);
+            }
+        }
+        size_t false_positives = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& probe : probes) false_positives += probe.first->bloom.Query(probe.second);
+        double probe_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "    Bloom: " << filter_bytes / 1024 << " KB, allocated " << level_bloom_bits_per_key_[level_idx] << ", built "
+                  << (total_entries ? filter_bytes * 8.0 / total_entries : 0.0) << " bits/key, measured FPR "
+                  << (probes.empty() ? 0.0 : 100.0 * false_positives / probes.size()) << "% over " << probes.size()
+                  << " absent keys, " << (probes.empty() ? 0.0 : probe_ns / probes.size()) << " ns/probe" << std::endl;
+    }
+
     size_t get_max_entries_for_level(int level_idx) const {
         if (level_idx < 0) return 0;
         // L0 limit is by number of SSTables (max_level0_sstables_)
@@ -272,11 +635,11 @@ private:
         if (level_idx == 0) { 
             return max_level0_sstables_ * sstable_target_entry_count_; 
         }
-        // Max entries L_i+1 = level_entry_multiplier_ * Max entries L_i
+        // Max entries L_i = size ratio of L_i * Max entries L_i-1
         size_t max_l0_entries = max_level0_sstables_ * sstable_target_entry_count_; 
         size_t max_entries = max_l0_entries;
-        for (int i = 0; i < level_idx; ++i) { // level_idx is 1-based for this loop conceptually
-            max_entries = static_cast<size_t>(max_entries * level_entry_multiplier_);
+        for (int i = 1; i <= level_idx; ++i) {
+            max_entries = static_cast<size_t>(max_entries * compaction_policy_.size_ratio(i, level_entry_multiplier_));
         }
         return max_entries;
     }
@@ -287,11 +650,7 @@ private:
             compaction_cv_.wait(lock, [this] {
                 if(shutdown_requested_) return true;
                 std::shared_lock<std::shared_mutex> levels_lock(levels_metadata_mutex_);
-                if (levels_[0].size() > max_level0_sstables_) return true; // L0 compaction based on file count
-                for (int i = 0; i < max_levels_ - 1; ++i) { // Check L0 to L_N-2 for size-based compaction into next level
-                    if (get_level_total_entries(i) > get_max_entries_for_level(i)) return true;
-                }
-                return false;
+                return pick_compaction_nolock() >= 0;
             });
 
             if (shutdown_requested_) break;
@@ -299,152 +658,332 @@ private:
             perform_compaction_check();
         }
     }
-    
-    void perform_compaction_check() {
-        std::unique_lock<std::shared_mutex> levels_lock(levels_metadata_mutex_); 
-        if (levels_[0].size() > max_level0_sstables_) {
-            std::vector<SSTablePtr> l0_ssts = levels_[0]; // Copy shared_ptrs
-            std::vector<SSTablePtr> l1_overlap_ssts;
-            if (max_levels_ > 1) {
-                l1_overlap_ssts = find_overlapping_sstables_nolock(l0_ssts, 1);
-            }
-            levels_lock.unlock(); 
 
-            compact_sstables(0, l0_ssts, l1_overlap_ssts);
-            return; 
-        }
-        
-        for (int i = 0; i < max_levels_ - 1; ++i) { // Check L_i -> L_{i+1}
-            size_t current_level_entries = get_level_total_entries(i); // Needs lock if not already held
-            size_t max_level_entries_threshold = get_max_entries_for_level(i);
-
-            if (current_level_entries > max_level_entries_threshold) {
-                // Simplistic: compact whole level 'i' if too big. Better: pick specific SSTables.
-                std::vector<SSTablePtr> li_ssts = levels_[i]; // Copy shared_ptrs
-                std::vector<SSTablePtr> li_plus_1_overlap_ssts = find_overlapping_sstables_nolock(li_ssts, i + 1);
-                
-                levels_lock.unlock(); // Unlock before heavy operation
-                compact_sstables(i, li_ssts, li_plus_1_overlap_ssts);
-                return; 
+    // Source level of a compaction that is due and whose levels no other worker is
+    // compacting, or -1. L0 is compacted by file count, L1+ by entries or by runs over
+    // the policy's K, and the last level when it has more runs than Z.
+    // Caller must hold levels_metadata_mutex_ (shared is fine)
+    int pick_compaction_nolock() const {
+        int last_level_idx = max_levels_ - 1;
+        auto pair_free = [this](int i) { return !level_compacting_[i] && !level_compacting_[i + 1]; };
+        if (max_levels_ > 1 && levels_[0].size() > max_level0_sstables_ && pair_free(0)) return 0;
+        for (int i = 0; i < last_level_idx; ++i) { // Check L_i -> L_{i+1}
+            bool too_many_runs = i > 0 && levels_[i].size() > compaction_policy_.runs_limit(i, max_levels_);
+            if ((too_many_runs || get_level_total_entries(i) > get_max_entries_for_level(i)) && pair_free(i)) return i;
+        }
+        if (last_level_idx > 0 && !level_compacting_[last_level_idx] &&
+            levels_[last_level_idx].size() > compaction_policy_.runs_limit(last_level_idx, max_levels_)) {
+            return last_level_idx;
+        }
+        return -1;
+    }
+
+    struct CompactionJob {
+        int source_level_idx;
+        int target_level_idx;              // source_level_idx itself for the last level
+        std::vector<SSTablePtr> source_ssts; // oldest first
+        std::vector<SSTablePtr> target_ssts; // tables of the target's newest run that the output replaces
+        size_t source_runs = 0;            // runs of the source level the job consumes whole
+        bool new_run = false;              // the output becomes a run of its own in the target level
+        bool drop_tombstones = false;
+    };
+
+    // A leveled L1+ level feeding a leveled level pushes down one table at a time, merged
+    // with the tables it overlaps in the next level. Otherwise the whole level is merged:
+    // L0 tables overlap each other, and so do the runs of a tiered level. The output goes
+    // into the target's run if the target is leveled, or becomes a new run if it is tiered.
+    // The last level merges all of its runs into one.
+    // Caller must hold levels_metadata_mutex_ exclusively.
+    CompactionJob plan_compaction_nolock(int source_level_idx) {
+        int last_level_idx = max_levels_ - 1;
+        CompactionJob job;
+        job.source_level_idx = source_level_idx;
+        job.target_level_idx = source_level_idx == last_level_idx ? source_level_idx : source_level_idx + 1;
+        const auto& source = levels_[source_level_idx];
+        const auto& target = levels_[job.target_level_idx];
+        bool leveled_target = source_level_idx < last_level_idx &&
+                              compaction_policy_.runs_limit(job.target_level_idx, max_levels_) == 1;
+
+        if (source_level_idx > 0 && source.size() == 1 && leveled_target) {
+            job.source_ssts.push_back(pick_source_table_nolock(source_level_idx));
+            compaction_cursor_[source_level_idx] = job.source_ssts[0]->max_key + 1; // wraps to 0 at the end
+        } else {
+            for (const auto& run : source) job.source_ssts.insert(job.source_ssts.end(), run.tables.begin(), run.tables.end());
+            job.source_runs = source.size();
+        }
+
+        if (leveled_target && !target.empty()) {
+            KeyType min_key = job.source_ssts.front()->min_key, max_key = job.source_ssts.front()->max_key;
+            for (const auto& sst : job.source_ssts) {
+                min_key = std::min(min_key, sst->min_key);
+                max_key = std::max(max_key, sst->max_key);
             }
-        }
-        // If lock was taken and no compaction happened, it will be released when current_level_lock goes out of scope
-        // or explicitly released if it was the top-level `levels_lock`.
-        // Ensure `levels_lock` is released if no compaction is triggered from the loop.
-        // The above structure unlocks before calling compact_sstables, or the loop finishes and lock is released.
+            job.target_ssts = target.back().overlapping(min_key, max_key);
+        } else {
+            job.new_run = true;
+        }
+        // Tombstones must keep shadowing older versions below them, so they can only be
+        // dropped when no older run remains in or below the output's level
+        job.drop_tombstones = job.target_level_idx == last_level_idx &&
+                              (source_level_idx == last_level_idx || target.size() <= (job.new_run ? 0u : 1u));
+        return job;
     }
 
-    // Assumes levels_metadata_mutex_ is already held (shared or exclusive) by caller.
-    std::vector<SSTablePtr> find_overlapping_sstables_nolock(const std::vector<SSTablePtr>& source_ssts, int target_level_idx) {
-        std::vector<SSTablePtr> overlapping;
-        if (source_ssts.empty() || target_level_idx < 0 || target_level_idx >= max_levels_) {
-            return overlapping;
-        }
+    void perform_compaction_check() {
+        std::unique_lock<std::shared_mutex> levels_lock(levels_metadata_mutex_);
+        int source_level_idx = pick_compaction_nolock();
+        if (source_level_idx < 0) return;
+        CompactionJob job = plan_compaction_nolock(source_level_idx);
+
+        // Trivial move: a table, or a single run, that overlaps nothing it would be merged
+        // with joins the next level unchanged
+        size_t tombstones = 0;
+        for (const auto& sst : job.source_ssts) tombstones += sst->tombstone_count;
+        if (job.target_level_idx > source_level_idx && job.target_ssts.empty() && job.source_runs <= 1 &&
+            (!job.drop_tombstones || tombstones == 0)) {
+            move_down_nolock(job);
+            levels_lock.unlock();
+            { std::lock_guard<std::mutex> lock(compaction_mutex_); }
+            compaction_cv_.notify_all();
+            if (source_level_idx == 0) notify_stalled_writers();
+            return;
+        }
+        level_compacting_[job.source_level_idx] = level_compacting_[job.target_level_idx] = true;
+        levels_lock.unlock(); // Unlock before heavy operation
+
+        compact_sstables(job);
+
+        levels_lock.lock();
+        level_compacting_[job.source_level_idx] = level_compacting_[job.target_level_idx] = false;
+        levels_lock.unlock();
+        // The levels are free again, and may now be due themselves
+        { std::lock_guard<std::mutex> lock(compaction_mutex_); }
+        compaction_cv_.notify_all();
+        if (source_level_idx == 0) notify_stalled_writers();
+    }
 
-        KeyType overall_min_key = source_ssts.front()->min_key;
-        KeyType overall_max_key = source_ssts.front()->max_key; // This should be max_key of the last SSTable if sorted
-        for(const auto& sst : source_ssts) { // Recalculate true overall range
-            if (sst->min_key < overall_min_key) overall_min_key = sst->min_key;
-            if (sst->max_key > overall_max_key) overall_max_key = sst->max_key;
-        }
-        
-        const auto& target_level_files = levels_[target_level_idx];
-        for (const auto& sst : target_level_files) {
-            if (sst->min_key <= overall_max_key && sst->max_key >= overall_min_key) { // Standard overlap condition
-                overlapping.push_back(sst);
+    // The table of a leveled L1+ level to push down next: the one with the largest share
+    // of tombstones if that reaches LSM_TOMBSTONE_COMPACTION_RATIO, so deletes reach the
+    // last level and free their space sooner, and otherwise the first table at or after
+    // the level's cursor. Caller must hold levels_metadata_mutex_ (shared is fine)
+    SSTablePtr pick_source_table_nolock(int level_idx) const {
+        const auto& level = levels_[level_idx].front().tables;
+        SSTablePtr densest;
+        double densest_ratio = LSM_TOMBSTONE_COMPACTION_RATIO;
+        for (const auto& sst : level) {
+            double ratio = static_cast<double>(sst->tombstone_count) / sst->entry_count;
+            if (ratio >= densest_ratio) {
+                densest = sst;
+                densest_ratio = ratio;
             }
         }
-        return overlapping;
+        if (densest) return densest;
+        auto it = std::lower_bound(level.begin(), level.end(), compaction_cursor_[level_idx],
+                                   [](const SSTablePtr& sst, KeyType key) { return sst->min_key < key; });
+        return it == level.end() ? level.front() : *it;
     }
 
-    void compact_sstables(int source_level_idx,
-                          const std::vector<SSTablePtr>& ssts_from_source, // Passed by value (vector of shared_ptr)
-                          const std::vector<SSTablePtr>& ssts_from_target_overlap) { // Passed by value
-        
-        if (ssts_from_source.empty()) return;
-        int target_level_idx = source_level_idx + 1;
+    // Caller must hold levels_metadata_mutex_ exclusively
+    void move_down_nolock(const CompactionJob& job) {
+        remove_from_level_nolock(job.source_level_idx, job.source_ssts);
+        add_to_level_nolock(job, job.source_ssts);
+        trivial_moves_ += job.source_ssts.size();
+    }
 
-        if (target_level_idx >= max_levels_) { // Cannot compact from last level to a new one
-             // Compaction within the last level could be implemented if needed.
-            return; 
+    // Takes ssts out of the runs of a level, dropping runs left empty.
+    // Caller must hold levels_metadata_mutex_ exclusively.
+    void remove_from_level_nolock(int level_idx, const std::vector<SSTablePtr>& ssts) {
+        std::vector<const SSTable*> removed;
+        for (const auto& sst : ssts) removed.push_back(sst.get());
+        std::sort(removed.begin(), removed.end());
+        auto& level = levels_[level_idx];
+        for (auto& run : level) {
+            auto kept_end = std::remove_if(run.tables.begin(), run.tables.end(), [&](const SSTablePtr& sst) {
+                return std::binary_search(removed.begin(), removed.end(), sst.get());
+            });
+            if (kept_end == run.tables.end()) continue;
+            run.tables.erase(kept_end, run.tables.end());
+            run.refresh();
         }
+        level.erase(std::remove_if(level.begin(), level.end(), [](const LevelRun& run) { return run.tables.empty(); }),
+                    level.end());
+        if (level_idx == 0) level0_runs_ = level.size();
+    }
 
-        MemTable merged_data_map; // K-V pairs after merging, tombstones not yet removed
+    // Installs the output of job in its target level: as the newest run, or in place of
+    // job.target_ssts in the newest run. Caller must hold levels_metadata_mutex_ exclusively.
+    void add_to_level_nolock(const CompactionJob& job, const std::vector<SSTablePtr>& ssts) {
+        auto& target = levels_[job.target_level_idx];
+        if (job.new_run) {
+            if (!ssts.empty()) target.emplace_back(ssts);
+            return;
+        }
+        LevelRun& run = target.back();
+        std::vector<const SSTable*> replaced;
+        for (const auto& sst : job.target_ssts) replaced.push_back(sst.get());
+        std::sort(replaced.begin(), replaced.end());
+        run.tables.erase(std::remove_if(run.tables.begin(), run.tables.end(), [&](const SSTablePtr& sst) {
+                             return std::binary_search(replaced.begin(), replaced.end(), sst.get());
+                         }), run.tables.end());
+        run.tables.insert(run.tables.end(), ssts.begin(), ssts.end());
+        // Sort by min_key (crucial for the non-overlapping property of a run)
+        std::sort(run.tables.begin(), run.tables.end(),
+                  [](const SSTablePtr& a, const SSTablePtr& b) { return a->min_key < b->min_key; });
+        run.refresh();
+        if (run.tables.empty()) target.pop_back();
+    }
 
-        auto load_map_from_sst_list = [&](const std::vector<SSTablePtr>& sst_list_to_load) {
-            for (const auto& sst_ptr : sst_list_to_load) {
-                for (const auto& pair : sst_ptr->data) {
-                    MemTable::accessor acc;
-                    merged_data_map.insert(acc, pair.first);
-                    acc->second = pair.second;
-                }
-            }
-        };
-        
-        // Process older data first (target level), then newer (source level)
-        load_map_from_sst_list(ssts_from_target_overlap);
-        load_map_from_sst_list(ssts_from_source);
-        
-        // Remove tombstones from the final merged data
-        std::vector<KeyType> keys_to_erase;
-        for (auto it = merged_data_map.begin(); it != merged_data_map.end(); ++it) {
-            if (it->second == TOMBSTONE_VALUE) {
-                keys_to_erase.push_back(it->first);
+    // Keys that split a compaction into up to LSM_SUBCOMPACTION_THREADS ranges of similar
+    // input size. Quantiles are taken over keys sampled from every input, then moved to
+    // the nearest boundary between target-level tables, so each of those is rewritten by
+    // a single range.
+    std::vector<KeyType> pick_subcompaction_cuts(const std::vector<SSTablePtr>& inputs,
+                                                 const std::vector<SSTablePtr>& target_ssts,
+                                                 size_t input_entries) const {
+        constexpr size_t SAMPLES_PER_TABLE = 16;
+        std::vector<KeyType> cuts;
+        size_t ranges = std::min(LSM_SUBCOMPACTION_THREADS, input_entries / std::max<size_t>(1, sstable_target_entry_count_));
+        if (ranges < 2) return cuts;
+
+        std::vector<std::pair<KeyType, size_t>> samples; // key, entries it stands for
+        for (const auto& sst : inputs) {
+            size_t step = std::max<size_t>(1, sst->entry_count / SAMPLES_PER_TABLE);
+            for (size_t pos = 0; pos < sst->entry_count; pos += step) {
+                samples.emplace_back(sst->keys[pos], std::min(step, sst->entry_count - pos));
             }
         }
-        for (const auto& k : keys_to_erase) {
-            merged_data_map.erase(k);
+        std::sort(samples.begin(), samples.end());
+        std::vector<KeyType> boundaries; // target_ssts is ordered by min_key
+        for (size_t t = 1; t < target_ssts.size(); ++t) boundaries.push_back(target_ssts[t]->min_key);
+
+        size_t seen = 0;
+        for (const auto& sample : samples) {
+            if (cuts.size() + 1 == ranges) break;
+            seen += sample.second;
+            if (seen * ranges < (cuts.size() + 1) * input_entries) continue;
+            KeyType cut = sample.first;
+            if (!boundaries.empty()) {
+                auto it = std::lower_bound(boundaries.begin(), boundaries.end(), cut);
+                if (it == boundaries.end() || (it != boundaries.begin() && cut - *(it - 1) < *it - cut)) --it;
+                cut = *it;
+            }
+            if (cut > (cuts.empty() ? samples.front().first : cuts.back())) cuts.push_back(cut);
         }
+        return cuts;
+    }
 
-        std::vector<SSTablePtr> new_ssts_for_target;
-        if (!merged_data_map.empty()) {
-            MemTable current_sstable_build_data;
-            for (const auto& pair : merged_data_map) {
-                { // Explicit scope for accessor
-                    MemTable::accessor acc;
-                    current_sstable_build_data.insert(acc, pair.first);
-                    acc->second = pair.second;
-                } // acc is destroyed here
-                if (current_sstable_build_data.size() >= sstable_target_entry_count_) {
-                    SSTablePtr new_sst = SSTable::create_from_memtable(
-                        current_sstable_build_data, next_sstable_id_++);
-                    if (new_sst) new_ssts_for_target.push_back(new_sst);
-                    current_sstable_build_data.clear(); // Now safe
-                }
+    // Merges the entries with *lo <= key < *hi (a null bound is open) of inputs, ordered
+    // oldest first, into new tables for the target level. The inputs are streamed
+    // through a loser tree in key order, newest version first, and written straight
+    // into the key and value arrays of the output tables, so nothing is hashed or
+    // buffered beyond one output table.
+    std::vector<SSTablePtr> merge_key_range(const std::vector<SSTablePtr>& inputs, const KeyType* lo,
+                                            const KeyType* hi, bool drop_tombstones, double bloom_bits_per_key) {
+        // Consecutive inputs that are disjoint and ascending belong to one sorted run (a
+        // level's tables are listed in key order) and share a cursor, which keeps the
+        // tree small. Nothing lies between them in age, so ties still go to the newest.
+        std::vector<TableRunCursor> cursors;
+        std::vector<TableRunCursor::Slice> run;
+        size_t input_entries = 0;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            const SSTable* sst = inputs[i].get();
+            if (i > 0 && sst->min_key <= inputs[i - 1]->max_key) {
+                cursors.emplace_back(std::move(run));
+                run.clear();
+            }
+            size_t begin = lo ? sst->lower_bound_index(*lo) : 0;
+            size_t end = hi ? sst->lower_bound_index(*hi) : sst->entry_count;
+            run.push_back({sst, begin, end});
+            input_entries += end - begin;
+        }
+        if (!run.empty()) cursors.emplace_back(std::move(run));
+        LoserTree merge(std::move(cursors));
+
+        std::vector<SSTablePtr> new_ssts;
+        std::vector<KeyType> keys;
+        std::vector<ValueType> values;
+        size_t consumed = 0;
+        auto start_table = [&] {
+            size_t expected = std::min(sstable_target_entry_count_, input_entries - consumed);
+            keys.reserve(expected);
+            values.reserve(expected);
+        };
+        auto finish_table = [&] {
+            new_ssts.push_back(std::make_shared<SSTable>(next_sstable_id_++, std::move(keys), std::move(values),
+                                                         bloom_bits_per_key));
+            keys = {};
+            values = {};
+        };
+        start_table();
+        while (merge.valid()) {
+            // Tombstones must keep shadowing older versions in deeper levels and can
+            // only be dropped when nothing older lies below the output
+            KeyType key = merge.key();
+            if (!drop_tombstones || merge.value() != TOMBSTONE_VALUE) {
+                keys.push_back(key);
+                values.push_back(merge.value());
             }
-            if (!current_sstable_build_data.empty()) { // Remainder
-                SSTablePtr new_sst = SSTable::create_from_memtable(
-                    current_sstable_build_data, next_sstable_id_++);
-                if (new_sst) new_ssts_for_target.push_back(new_sst);
+            do { // Older versions of key
+                merge.next();
+                ++consumed;
+            } while (merge.valid() && merge.key() == key);
+            if (keys.size() == sstable_target_entry_count_) {
+                finish_table();
+                start_table();
             }
         }
+        if (!keys.empty()) finish_table();
+        return new_ssts;
+    }
+
+    void compact_sstables(const CompactionJob& job) {
+        int source_level_idx = job.source_level_idx;
+        int target_level_idx = job.target_level_idx;
+
+        // Inputs oldest first: the target level, then the source level, whose runs are
+        // ordered by age
+        std::vector<SSTablePtr> inputs(job.target_ssts);
+        inputs.insert(inputs.end(), job.source_ssts.begin(), job.source_ssts.end());
+        size_t input_entries = 0;
+        for (const auto& sst : inputs) input_entries += sst->entry_count;
+
+        // Size the new filters for the level sizes this compaction leaves behind, taking
+        // the output to be as large as the input
+        std::vector<double> bloom_plan;
+        {
+            std::shared_lock<std::shared_mutex> lock(levels_metadata_mutex_);
+            std::vector<LevelShape> shapes = level_shapes_nolock();
+            for (const auto& sst : job.source_ssts) shapes[source_level_idx].entries -= sst->entry_count;
+            shapes[source_level_idx].runs -= job.source_runs;
+            for (const auto& sst : job.target_ssts) shapes[target_level_idx].entries -= sst->entry_count;
+            shapes[target_level_idx].entries += input_entries;
+            if (job.new_run) ++shapes[target_level_idx].runs;
+            bloom_plan = plan_bloom_bits(shapes);
+        }
+
+        // Subcompactions: disjoint key ranges merged in parallel, whose outputs
+        // concatenate into the new run
+        std::vector<KeyType> cuts = pick_subcompaction_cuts(inputs, job.target_ssts, input_entries);
+        std::vector<std::vector<SSTablePtr>> range_outputs(cuts.size() + 1);
+        subcompaction_arena_.execute([&] {
+            tbb::parallel_for(size_t(0), range_outputs.size(), [&](size_t r) {
+                range_outputs[r] = merge_key_range(inputs, r > 0 ? &cuts[r - 1] : nullptr,
+                                                   r < cuts.size() ? &cuts[r] : nullptr, job.drop_tombstones,
+                                                   bloom_plan[target_level_idx]);
+            });
+        });
+        std::vector<SSTablePtr> new_ssts_for_target;
+        for (auto& output : range_outputs) {
+            for (const auto& sst : output) compacted_entries_ += sst->entry_count;
+            new_ssts_for_target.insert(new_ssts_for_target.end(), output.begin(), output.end());
+        }
 
         // Atomically update levels_ metadata
         {
             std::unique_lock<std::shared_mutex> lock(levels_metadata_mutex_);
-            
-            auto remove_compacted_ssts = [&](std::vector<SSTablePtr>& level_vec, const std::vector<SSTablePtr>& compacted_ssts) {
-                level_vec.erase(std::remove_if(level_vec.begin(), level_vec.end(),
-                    [&](const SSTablePtr& sst_in_level) {
-                        return std::find_if(compacted_ssts.begin(), compacted_ssts.end(),
-                                       [&](const SSTablePtr& sst_to_remove){ return sst_to_remove->id == sst_in_level->id; }) 
-                                       != compacted_ssts.end();
-                    }), level_vec.end());
-            };
-
-            remove_compacted_ssts(levels_[source_level_idx], ssts_from_source);
-            if (target_level_idx < max_levels_) {
-                remove_compacted_ssts(levels_[target_level_idx], ssts_from_target_overlap);
-                levels_[target_level_idx].insert(levels_[target_level_idx].end(),
-                                                 new_ssts_for_target.begin(),
-                                                 new_ssts_for_target.end());
-                // Sort target level SSTables by min_key (crucial for L1+ non-overlapping property)
-                 std::sort(levels_[target_level_idx].begin(), levels_[target_level_idx].end(), 
-                           [](const SSTablePtr& a, const SSTablePtr& b) {
-                    if (a->min_key != b->min_key) return a->min_key < b->min_key;
-                    return a->id < b->id; 
-                });
-            }
+            level_bloom_bits_per_key_ = std::move(bloom_plan);
+            remove_from_level_nolock(source_level_idx, job.source_ssts);
+            add_to_level_nolock(job, new_ssts_for_target);
         }
         // Old SSTable objects (now in-memory) will be destructed automatically when shared_ptr ref counts drop to zero.
     }
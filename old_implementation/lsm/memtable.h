@@ -0,0 +1,84 @@
+#ifndef MEMTABLE_H
+#define MEMTABLE_H
+
+#include "global.h"
+#include "lsm_iterator.h"
+#include <tbb/concurrent_hash_map.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+enum class MemTableType { Hash, SkipList };
+
+// Write buffer of an LSMTree. put() may be called concurrently with itself and with
+// readers. Entries are raw: deletes are stored as TOMBSTONE_VALUE and returned as such.
+// Memtables are shared_ptr-owned so open iterators can keep one alive after it is flushed.
+class MemTable : public std::enable_shared_from_this<MemTable> {
+public:
+    virtual ~MemTable() = default;
+
+    virtual void put(KeyType key, const ValueType& value) = 0;
+    // Latest value written for key
+    virtual bool get(KeyType key, ValueType& value) const = 0;
+    // Entries held, which is what the flush threshold is compared against
+    virtual size_t size() const = 0;
+    bool empty() const { return size() == 0; }
+
+    // Latest value of every key, in key order
+    virtual std::vector<std::pair<KeyType, ValueType>> sorted_entries() const = 0;
+    // Cursor over the latest values; implementations may restrict it to [lo, hi]
+    virtual std::unique_ptr<SortedRun> new_run(KeyType lo, KeyType hi) const = 0;
+};
+
+// Unordered memtable: fast point operations, but flushes and scans have to sort.
+// tbb::concurrent_hash_map cannot be iterated during inserts, so puts share
+// iteration_mutex_ and sorted_entries()/new_run() take it exclusively.
+class HashMemTable : public MemTable {
+public:
+    void put(KeyType key, const ValueType& value) override {
+        std::shared_lock<std::shared_mutex> lock(iteration_mutex_);
+        Map::accessor acc;
+        map_.insert(acc, key);
+        acc->second = value;
+    }
+
+    bool get(KeyType key, ValueType& value) const override {
+        Map::const_accessor acc;
+        if (!map_.find(acc, key)) return false;
+        value = acc->second;
+        return true;
+    }
+
+    size_t size() const override { return map_.size(); }
+
+    std::vector<std::pair<KeyType, ValueType>> sorted_entries() const override {
+        return sorted_range(std::numeric_limits<KeyType>::min(), std::numeric_limits<KeyType>::max());
+    }
+
+    // Copies and sorts the entries in [lo, hi]
+    std::unique_ptr<SortedRun> new_run(KeyType lo, KeyType hi) const override {
+        return std::make_unique<EntryVectorRun>(sorted_range(lo, hi));
+    }
+
+private:
+    using Map = tbb::concurrent_hash_map<KeyType, ValueType>;
+    Map map_;
+    mutable std::shared_mutex iteration_mutex_;
+
+    std::vector<std::pair<KeyType, ValueType>> sorted_range(KeyType lo, KeyType hi) const {
+        std::unique_lock<std::shared_mutex> lock(iteration_mutex_);
+        std::vector<std::pair<KeyType, ValueType>> entries;
+        for (const auto& kv : map_) {
+            if (kv.first >= lo && kv.first <= hi) entries.emplace_back(kv.first, kv.second);
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        return entries;
+    }
+};
+
+#endif // MEMTABLE_H
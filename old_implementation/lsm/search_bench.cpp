@@ -0,0 +1,91 @@
+// Compares the ways an SSTable can find a key in its sorted key array: plain binary
+// search, fence pointers (SSTABLE_FENCE_INTERVAL) and the learned index at several
+// epsilons. Each method runs the same random lookups, half of them for absent keys,
+// and every answer is checked against std::lower_bound.
+//
+// Usage: lsm_search_bench [keys per table] [lookups]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "global.h"
+#include "learned_index.h"
+
+static std::vector<KeyType> make_keys(const std::string& dist, size_t n, std::mt19937_64& rng) {
+    std::vector<KeyType> keys;
+    keys.reserve(n);
+    if (dist == "dense") {
+        // Even keys, so the odd ones in between are absent
+        for (size_t i = 0; i < n; ++i) keys.push_back(1000 + 2 * i);
+    } else if (dist == "uniform") {
+        while (keys.size() < n) keys.push_back(rng() >> 1);
+    } else {
+        // lognormal gaps: long runs of close keys separated by large jumps
+        std::lognormal_distribution<double> gap(0.0, 2.0);
+        KeyType k = 0;
+        for (size_t i = 0; i < n; ++i) keys.push_back(k += 2 + static_cast<KeyType>(gap(rng)));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+static void run(const char* name, const std::vector<KeyType>& probes, const std::vector<size_t>& expected,
+                const std::function<size_t(KeyType)>& search, size_t bytes) {
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (KeyType key : probes) checksum += search(key);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        if (search(probes[i]) != expected[i]) throw std::runtime_error(std::string(name) + " returned a wrong position");
+    }
+    std::printf("  %-22s %7.1f ns/lookup  %8zu index bytes  (checksum %zu)\n", name, ns / probes.size(), bytes,
+                checksum);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16 * 1024;
+    size_t lookups = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+    std::mt19937_64 rng(42);
+
+    for (const std::string dist : {"dense", "uniform", "lognormal"}) {
+        std::vector<KeyType> keys = make_keys(dist, n, rng);
+        std::vector<KeyType> probes;
+        for (size_t i = 0; i < lookups; ++i) {
+            KeyType key = keys[rng() % keys.size()];
+            probes.push_back(i % 2 ? key : key + 1);
+        }
+        std::vector<size_t> expected;
+        for (KeyType key : probes) expected.push_back(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+
+        std::printf("%s keys, %zu per table, %zu lookups\n", dist.c_str(), keys.size(), lookups);
+        run("binary search", probes, expected,
+            [&](KeyType key) { return std::lower_bound(keys.begin(), keys.end(), key) - keys.begin(); }, 0);
+
+        std::vector<KeyType> fences;
+        for (size_t pos = 0; pos < keys.size(); pos += SSTABLE_FENCE_INTERVAL) fences.push_back(keys[pos]);
+        run("fence pointers", probes, expected, [&](KeyType key) {
+            auto fence_it = std::upper_bound(fences.begin(), fences.end(), key);
+            if (fence_it == fences.begin()) return size_t(0);
+            size_t block_start = (fence_it - fences.begin() - 1) * SSTABLE_FENCE_INTERVAL;
+            size_t block_end = std::min(block_start + SSTABLE_FENCE_INTERVAL, keys.size());
+            return size_t(std::lower_bound(keys.begin() + block_start, keys.begin() + block_end, key) - keys.begin());
+        }, fences.size() * sizeof(KeyType));
+
+        for (size_t epsilon : {4, 16, 64}) {
+            LearnedIndex index;
+            index.train(keys, epsilon);
+            std::string name = "learned eps=" + std::to_string(epsilon) + " (" + std::to_string(index.segment_count()) + " seg)";
+            run(name.c_str(), probes, expected, [&](KeyType key) { return index.lower_bound(keys.data(), key); },
+                index.size_bytes());
+        }
+    }
+    return 0;
+}
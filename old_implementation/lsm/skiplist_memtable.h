@@ -0,0 +1,182 @@
+#ifndef SKIPLIST_MEMTABLE_H
+#define SKIPLIST_MEMTABLE_H
+
+#include "memtable.h"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+// Tallest tower in the skiplist; with a 1/4 branching factor this covers ~4^16 entries
+constexpr int SKIPLIST_MAX_HEIGHT = 16;
+
+// Lock-free ordered memtable for uint64 keys, adapted from the SkipList in
+// LSM/memtable/custom_skiplist.h. A memtable never removes entries (deletes are
+// tombstones) and overwrites are stored as new versions, so the marked references and
+// the unlinking of the original are not needed. Every put links a fresh, immutable node
+// ordered by (key ascending, sequence number descending) with one CAS per level;
+// readers take no locks and the newest version of a key is the first one they reach.
+// Flushing walks the bottom level once and emits a sorted run directly.
+class SkipListMemTable : public MemTable {
+public:
+    SkipListMemTable() : head_(new_node(0, 0, ValueType(), SKIPLIST_MAX_HEIGHT)) {}
+
+    ~SkipListMemTable() override {
+        Node* x = head_;
+        while (x) {
+            Node* next = x->next[0].load(std::memory_order_relaxed);
+            free_node(x);
+            x = next;
+        }
+    }
+
+    SkipListMemTable(const SkipListMemTable&) = delete;
+    SkipListMemTable& operator=(const SkipListMemTable&) = delete;
+
+    void put(KeyType key, const ValueType& value) override {
+        uint64_t seq = next_seq_.fetch_add(1, std::memory_order_relaxed) + 1;
+        int height = random_height();
+        Node* node = new_node(key, seq, value, height);
+
+        Node* preds[SKIPLIST_MAX_HEIGHT];
+        Node* succs[SKIPLIST_MAX_HEIGHT];
+        Node* x = head_;
+        for (int level = SKIPLIST_MAX_HEIGHT - 1; level >= 0; --level) {
+            find_splice(x, level, key, seq, preds[level], succs[level]);
+            x = preds[level];
+        }
+        // Link bottom-up: once level 0 is published the entry is visible, the upper
+        // levels only speed up searches. Nodes are never unlinked, so after a failed
+        // CAS the new splice lies to the right of the old predecessor.
+        for (int level = 0; level < height; ++level) {
+            while (true) {
+                node->next[level].store(succs[level], std::memory_order_relaxed);
+                if (preds[level]->next[level].compare_exchange_weak(succs[level], node, std::memory_order_release,
+                                                                    std::memory_order_relaxed)) {
+                    break;
+                }
+                find_splice(preds[level], level, key, seq, preds[level], succs[level]);
+            }
+        }
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool get(KeyType key, ValueType& value) const override {
+        const Node* x = seek_node(key);
+        if (!x || x->key != key) return false;
+        value = x->value;
+        return true;
+    }
+
+    // Counts every version, so overwrites also fill the table
+    size_t size() const override { return count_.load(std::memory_order_relaxed); }
+
+    std::vector<std::pair<KeyType, ValueType>> sorted_entries() const override {
+        std::vector<std::pair<KeyType, ValueType>> entries;
+        entries.reserve(size());
+        for (const Node* x = head_->next[0].load(std::memory_order_acquire); x; x = next_key(x)) {
+            entries.emplace_back(x->key, x->value);
+        }
+        return entries;
+    }
+
+    // Reads the list in place; lo and hi are not needed. Entries put while the cursor
+    // is open may or may not be seen.
+    std::unique_ptr<SortedRun> new_run(KeyType, KeyType) const override {
+        return std::make_unique<Run>(std::static_pointer_cast<const SkipListMemTable>(shared_from_this()));
+    }
+
+private:
+    struct Node {
+        KeyType key;
+        uint64_t seq;
+        ValueType value;
+        int height;
+        std::atomic<Node*> next[1];  // height entries, allocated past the end of the struct
+    };
+
+    class Run : public SortedRun {
+    public:
+        explicit Run(std::shared_ptr<const SkipListMemTable> table) : table_(std::move(table)), node_(nullptr) {}
+        void seek(KeyType key) override { node_ = table_->seek_node(key); }
+        bool valid() const override { return node_ != nullptr; }
+        KeyType key() const override { return node_->key; }
+        const ValueType& value() const override { return node_->value; }
+        void next() override { node_ = next_key(node_); }
+
+    private:
+        std::shared_ptr<const SkipListMemTable> table_;
+        const Node* node_;
+    };
+
+    Node* const head_;
+    std::atomic<uint64_t> next_seq_{0};
+    std::atomic<size_t> count_{0};
+
+    static Node* new_node(KeyType key, uint64_t seq, const ValueType& value, int height) {
+        void* mem = ::operator new(sizeof(Node) + (height - 1) * sizeof(std::atomic<Node*>));
+        Node* node = new (mem) Node{key, seq, value, height, {}};
+        for (int level = 0; level < height; ++level) {
+            new (&node->next[level]) std::atomic<Node*>(nullptr);
+        }
+        return node;
+    }
+
+    static void free_node(Node* node) {
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    static int random_height() {
+        static thread_local uint64_t state = 0x9e3779b97f4a7c15ULL ^ reinterpret_cast<uintptr_t>(&state);
+        int height = 1;
+        while (height < SKIPLIST_MAX_HEIGHT) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            if ((state & 3) != 0) break;
+            ++height;
+        }
+        return height;
+    }
+
+    // True if node sorts before (key, seq)
+    static bool before(const Node* node, KeyType key, uint64_t seq) {
+        return node->key < key || (node->key == key && node->seq > seq);
+    }
+
+    // Walks level from x to the last node before (key, seq) and the successor it was
+    // compared against. The successor must not be reloaded: a node inserted since could
+    // also sort before (key, seq).
+    static void find_splice(Node* x, int level, KeyType key, uint64_t seq, Node*& pred, Node*& succ) {
+        Node* next = x->next[level].load(std::memory_order_acquire);
+        while (next && before(next, key, seq)) {
+            x = next;
+            next = x->next[level].load(std::memory_order_acquire);
+        }
+        pred = x;
+        succ = next;
+    }
+
+    // Newest version of the first key >= key
+    const Node* seek_node(KeyType key) const {
+        Node* x = head_;
+        Node* succ = nullptr;
+        for (int level = SKIPLIST_MAX_HEIGHT - 1; level >= 0; --level) {
+            find_splice(x, level, key, std::numeric_limits<uint64_t>::max(), x, succ);
+        }
+        return succ;
+    }
+
+    // Newest version of the next larger key
+    static const Node* next_key(const Node* x) {
+        KeyType key = x->key;
+        do {
+            x = x->next[0].load(std::memory_order_acquire);
+        } while (x && x->key == key);
+        return x;
+    }
+};
+
+#endif // SKIPLIST_MEMTABLE_H
@@ -0,0 +1,60 @@
+#ifndef WRITE_CONTROLLER_H
+#define WRITE_CONTROLLER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Paces writes while the tree is falling behind, as RocksDB's WriteController does. A
+// token bucket holds up to burst writes and refills at the rate given by the caller;
+// a write that finds it empty reserves the next token anyway, so the bucket goes into
+// debt and concurrent writers queue up behind each other, each waiting until its own
+// token is due. Also keeps the stall metrics.
+class WriteController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit WriteController(double burst) : burst_(burst), tokens_(burst), last_refill_(Clock::now()) {}
+
+    // Takes a token at rate writes per second and returns how long the caller must wait
+    // for it
+    std::chrono::nanoseconds reserve(double rate) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        tokens_ = std::min(burst_, tokens_ + std::chrono::duration<double>(now - last_refill_).count() * rate);
+        last_refill_ = now;
+        tokens_ -= 1.0;
+        if (tokens_ >= 0) return std::chrono::nanoseconds(0);
+        return std::chrono::nanoseconds(static_cast<int64_t>(-tokens_ / rate * 1e9));
+    }
+
+    void record_delay(std::chrono::nanoseconds waited) {
+        ++delayed_writes_;
+        delayed_ns_ += waited.count();
+    }
+
+    void record_stop(std::chrono::nanoseconds waited) {
+        ++stopped_writes_;
+        stopped_ns_ += waited.count();
+    }
+
+    uint64_t delayed_writes() const { return delayed_writes_.load(); }
+    uint64_t stopped_writes() const { return stopped_writes_.load(); }
+    double delayed_ms() const { return delayed_ns_.load() / 1e6; }
+    double stopped_ms() const { return stopped_ns_.load() / 1e6; }
+
+private:
+    std::mutex mutex_;
+    double burst_;
+    double tokens_;  // negative while writers are queued for tokens not yet refilled
+    Clock::time_point last_refill_;
+
+    std::atomic<uint64_t> delayed_writes_{0};
+    std::atomic<uint64_t> stopped_writes_{0};
+    std::atomic<uint64_t> delayed_ns_{0};
+    std::atomic<uint64_t> stopped_ns_{0};
+};
+
+#endif // WRITE_CONTROLLER_H
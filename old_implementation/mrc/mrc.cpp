@@ -0,0 +1,382 @@
+// Offline miss-ratio-curve analyzer for node/page access traces.
+//
+// Reads a PageTracer dump (btree/page_trace.h) or a text file with one page id per
+// line and prints the miss ratio of LRU, CLOCK and ARC caches across cache sizes.
+// Uses SHARDS spatial sampling: a page is kept iff hash(page) mod P < R*P, so every
+// access to a sampled page is kept. LRU comes from one pass of reuse distances over
+// the sample (scaled by 1/R); CLOCK and ARC run miniature simulations of size R*C
+// on the sample, one per cache size.
+//
+// Usage: mrc <trace> [--text] [--rate R] [--points N] [--max-pages M] [--page-size B]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "page_trace.h"
+
+static const uint64_t SHARDS_MODULUS = 1 << 24;
+static const size_t READ_BATCH_RECORDS = 1 << 16;
+
+struct Options {
+    std::string path;
+    bool text = false;
+    double rate = 0.01;
+    int points = 32;
+    uint64_t maxPages = 0;  // 0: up to the estimated number of distinct pages
+    uint64_t pageSize = 4096;
+};
+
+struct SampledTrace {
+    std::vector<uint64_t> pages;  // sampled accesses in time order
+    uint64_t totalAccesses = 0;
+    double rate = 1.0;
+};
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// ------------------------------------------------
+// Trace input
+// ------------------------------------------------
+static SampledTrace readTrace(const Options &opt) {
+    SampledTrace out;
+    uint64_t threshold = static_cast<uint64_t>(opt.rate * SHARDS_MODULUS);
+    if (threshold == 0) threshold = 1;
+    out.rate = static_cast<double>(threshold) / SHARDS_MODULUS;
+    auto sampled = [&](uint64_t page) { return mix64(page) % SHARDS_MODULUS < threshold; };
+
+    if (opt.text) {
+        std::ifstream in(opt.path);
+        if (!in.is_open()) throw std::runtime_error("cannot open trace " + opt.path);
+        uint64_t page;
+        while (in >> page) {
+            out.totalAccesses++;
+            if (sampled(page)) out.pages.push_back(page);
+        }
+        return out;
+    }
+
+    FILE *f = std::fopen(opt.path.c_str(), "rb");
+    if (!f) throw std::runtime_error("cannot open trace " + opt.path);
+    PageTraceHeader hdr;
+    if (std::fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != PAGE_TRACE_MAGIC ||
+        hdr.recordSize != sizeof(PageAccess)) {
+        std::fclose(f);
+        throw std::runtime_error(opt.path + " is not a page trace");
+    }
+    // Records are grouped by thread; sampled ones are re-interleaved by timestamp.
+    std::vector<std::pair<uint64_t, uint64_t>> timed;  // (tsc, page)
+    std::vector<PageAccess> batch(READ_BATCH_RECORDS);
+    size_t n;
+    while ((n = std::fread(batch.data(), sizeof(PageAccess), batch.size(), f)) > 0) {
+        out.totalAccesses += n;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t tsc = batch[i].tsc, page = batch[i].node;  // copies: fields are packed
+            if (sampled(page)) timed.emplace_back(tsc, page);
+        }
+    }
+    std::fclose(f);
+    if (hdr.threads > 1) std::stable_sort(timed.begin(), timed.end());
+    out.pages.reserve(timed.size());
+    for (auto &t : timed) out.pages.push_back(t.second);
+    if (hdr.overwritten > 0) {
+        std::cerr << "warning: " << hdr.overwritten << " accesses were overwritten in the tracer rings\n";
+    }
+    return out;
+}
+
+// ------------------------------------------------
+// LRU: reuse-distance histogram (SHARDS)
+// ------------------------------------------------
+// A Fenwick tree over sample positions marks each page's most recent access; the
+// number of marks after a page's previous access is its stack distance.
+class Fenwick {
+public:
+    explicit Fenwick(size_t n) : tree_(n + 1, 0) {}
+    void add(size_t i, int64_t delta) {
+        for (i++; i < tree_.size(); i += i & (~i + 1)) tree_[i] += delta;
+    }
+    int64_t prefix(size_t i) const {  // sum over [0, i)
+        int64_t s = 0;
+        for (; i > 0; i -= i & (~i + 1)) s += tree_[i];
+        return s;
+    }
+
+private:
+    std::vector<int64_t> tree_;
+};
+
+struct LruCurve {
+    std::vector<double> histogram;  // histogram[d]: reuses at distance d, in sampled pages
+    double coldMisses = 0;
+    double total = 0;
+    uint64_t distinctSampled = 0;
+    double bucketWidth = 1;  // real pages per sampled page (1 / rate)
+
+    double missRatio(uint64_t cachePages) const {
+        if (total <= 0) return 0.0;
+        // Accesses with distance < cachePages hit
+        double hits = 0;
+        size_t limit = std::min<size_t>(histogram.size(), static_cast<size_t>(cachePages / bucketWidth));
+        for (size_t d = 0; d < limit; d++) hits += histogram[d];
+        return std::max(0.0, 1.0 - hits / total);
+    }
+};
+
+static LruCurve lruCurve(const SampledTrace &trace) {
+    LruCurve curve;
+    curve.bucketWidth = 1.0 / trace.rate;
+    Fenwick marks(trace.pages.size());
+    std::unordered_map<uint64_t, size_t> last;
+    last.reserve(trace.pages.size() / 4 + 16);
+    for (size_t t = 0; t < trace.pages.size(); t++) {
+        uint64_t page = trace.pages[t];
+        auto it = last.find(page);
+        if (it == last.end()) {
+            curve.coldMisses += 1;
+            last.emplace(page, t);
+        } else {
+            // distinct sampled pages touched strictly between the two accesses
+            uint64_t distance = marks.prefix(t) - marks.prefix(it->second + 1);
+            if (distance >= curve.histogram.size()) curve.histogram.resize(distance + 1, 0.0);
+            curve.histogram[distance] += 1;
+            marks.add(it->second, -1);
+            it->second = t;
+        }
+        marks.add(t, 1);
+    }
+    curve.distinctSampled = last.size();
+    // SHARDS-adj: the sample holds trace.rate of all accesses only in expectation;
+    // the surplus or deficit is credited to the smallest distance.
+    double expected = trace.totalAccesses * trace.rate;
+    double actual = static_cast<double>(trace.pages.size());
+    if (curve.histogram.empty()) curve.histogram.resize(1, 0.0);
+    curve.histogram[0] += expected - actual;
+    curve.total = expected;
+    return curve;
+}
+
+// ------------------------------------------------
+// CLOCK and ARC miniature simulations
+// ------------------------------------------------
+static uint64_t simulateClock(const std::vector<uint64_t> &pages, size_t capacity) {
+    std::vector<uint64_t> frames;
+    std::vector<uint8_t> referenced;
+    std::unordered_map<uint64_t, size_t> where;
+    frames.reserve(capacity);
+    referenced.reserve(capacity);
+    where.reserve(capacity * 2);
+    size_t hand = 0;
+    uint64_t misses = 0;
+    for (uint64_t page : pages) {
+        auto it = where.find(page);
+        if (it != where.end()) {
+            referenced[it->second] = 1;
+            continue;
+        }
+        misses++;
+        if (frames.size() < capacity) {
+            where[page] = frames.size();
+            frames.push_back(page);
+            referenced.push_back(0);
+            continue;
+        }
+        while (referenced[hand]) {
+            referenced[hand] = 0;
+            hand = (hand + 1) % capacity;
+        }
+        where.erase(frames[hand]);
+        frames[hand] = page;
+        referenced[hand] = 0;
+        where[page] = hand;
+        hand = (hand + 1) % capacity;
+    }
+    return misses;
+}
+
+// Adaptive Replacement Cache (Megiddo & Modha). T1/T2 hold cached pages seen once /
+// at least twice, B1/B2 are ghost lists of recently evicted ones, p is T1's target.
+class ArcCache {
+public:
+    explicit ArcCache(size_t capacity) : c_(capacity) {}
+
+    bool access(uint64_t page) {
+        auto it = index_.find(page);
+        if (it != index_.end()) {
+            Entry &e = it->second;
+            if (e.list == T1 || e.list == T2) {
+                move(page, e, T2);
+                return true;
+            }
+            if (e.list == B1) {
+                p_ = std::min<double>(c_, p_ + std::max<double>(1.0, double(lists_[B2].size()) / lists_[B1].size()));
+                replace(false);
+            } else {
+                p_ = std::max<double>(0.0, p_ - std::max<double>(1.0, double(lists_[B1].size()) / lists_[B2].size()));
+                replace(true);
+            }
+            move(page, index_.find(page)->second, T2);
+            return false;
+        }
+        size_t l1 = lists_[T1].size() + lists_[B1].size();
+        size_t total = l1 + lists_[T2].size() + lists_[B2].size();
+        if (l1 == c_) {
+            if (lists_[T1].size() < c_) {
+                drop(B1);
+                replace(false);
+            } else {
+                drop(T1);
+            }
+        } else if (total >= c_) {
+            if (total == 2 * c_) drop(B2);
+            replace(false);
+        }
+        lists_[T1].push_front(page);
+        index_[page] = Entry{T1, lists_[T1].begin()};
+        return false;
+    }
+
+private:
+    enum ListId { T1 = 0, T2 = 1, B1 = 2, B2 = 3 };
+    struct Entry {
+        ListId list;
+        std::list<uint64_t>::iterator pos;
+    };
+
+    void move(uint64_t page, Entry &e, ListId to) {
+        lists_[e.list].erase(e.pos);
+        lists_[to].push_front(page);
+        e.list = to;
+        e.pos = lists_[to].begin();
+    }
+
+    void drop(ListId from) {  // forget the LRU page of a list entirely
+        uint64_t victim = lists_[from].back();
+        lists_[from].pop_back();
+        index_.erase(victim);
+    }
+
+    void replace(bool inB2) {
+        size_t t1 = lists_[T1].size();
+        if (t1 > 0 && (t1 > p_ || (inB2 && t1 == static_cast<size_t>(p_)))) {
+            move(lists_[T1].back(), index_.find(lists_[T1].back())->second, B1);
+        } else if (!lists_[T2].empty()) {
+            move(lists_[T2].back(), index_.find(lists_[T2].back())->second, B2);
+        } else if (t1 > 0) {
+            move(lists_[T1].back(), index_.find(lists_[T1].back())->second, B1);
+        }
+    }
+
+    size_t c_;
+    double p_ = 0;
+    std::list<uint64_t> lists_[4];
+    std::unordered_map<uint64_t, Entry> index_;
+};
+
+static uint64_t simulateArc(const std::vector<uint64_t> &pages, size_t capacity) {
+    ArcCache cache(capacity);
+    uint64_t misses = 0;
+    for (uint64_t page : pages) {
+        if (!cache.access(page)) misses++;
+    }
+    return misses;
+}
+
+// ------------------------------------------------
+// Driver
+// ------------------------------------------------
+static Options parseArgs(int argc, char *argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--text") {
+            opt.text = true;
+        } else if (arg == "--rate") {
+            opt.rate = std::stod(next());
+        } else if (arg == "--points") {
+            opt.points = std::stoi(next());
+        } else if (arg == "--max-pages") {
+            opt.maxPages = std::stoull(next());
+        } else if (arg == "--page-size") {
+            opt.pageSize = std::stoull(next());
+        } else if (opt.path.empty()) {
+            opt.path = arg;
+        } else {
+            throw std::runtime_error("unexpected argument " + arg);
+        }
+    }
+    if (opt.path.empty()) {
+        throw std::runtime_error(
+            "usage: mrc <trace> [--text] [--rate R] [--points N] [--max-pages M] [--page-size B]");
+    }
+    if (opt.rate <= 0 || opt.rate > 1) throw std::runtime_error("--rate must be in (0, 1]");
+    if (opt.points < 2) opt.points = 2;
+    return opt;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        Options opt = parseArgs(argc, argv);
+        auto start = std::chrono::high_resolution_clock::now();
+        SampledTrace trace = readTrace(opt);
+        LruCurve lru = lruCurve(trace);
+        double distinct = lru.distinctSampled / trace.rate;
+        uint64_t maxPages = opt.maxPages ? opt.maxPages : static_cast<uint64_t>(std::ceil(distinct));
+        if (maxPages < 1) maxPages = 1;
+
+        std::cerr << "Accesses: " << trace.totalAccesses << ", sampled: " << trace.pages.size()
+                  << " (rate " << trace.rate << "), est. distinct pages: " << static_cast<uint64_t>(distinct)
+                  << "\n";
+
+        // Cache sizes spaced geometrically from one sampled page (1/rate real pages) to maxPages
+        std::vector<uint64_t> sizes;
+        double lo = std::max(1.0, 1.0 / trace.rate);
+        double hi = std::max<double>(lo, maxPages);
+        for (int i = 0; i < opt.points; i++) {
+            uint64_t s = static_cast<uint64_t>(std::llround(lo * std::pow(hi / lo, double(i) / (opt.points - 1))));
+            if (sizes.empty() || s != sizes.back()) sizes.push_back(s);
+        }
+
+        std::cout << "cache_pages,cache_mb,lru_miss_ratio,clock_miss_ratio,arc_miss_ratio\n";
+        std::cout << std::fixed << std::setprecision(4);
+        // Like SHARDS-adj, a sample that over- or under-shoots its expected size is
+        // assumed to differ in hits only, so misses are normalized by lru.total.
+        auto ratio = [&](uint64_t misses) { return lru.total > 0 ? std::min(1.0, misses / lru.total) : 0.0; };
+        for (uint64_t pages : sizes) {
+            size_t scaled = std::max<size_t>(1, static_cast<size_t>(std::llround(pages * trace.rate)));
+            double clock = ratio(simulateClock(trace.pages, scaled));
+            double arc = ratio(simulateArc(trace.pages, scaled));
+            std::cout << pages << "," << pages * opt.pageSize / (1024.0 * 1024.0) << "," << lru.missRatio(pages)
+                      << "," << clock << "," << arc << "\n";
+        }
+        double elapsed =
+            std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cerr << "Done in " << elapsed << " s\n";
+    } catch (const std::exception &ex) {
+        std::cerr << "Exception: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
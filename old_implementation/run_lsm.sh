@@ -8,5 +8,6 @@ do
     # /mydata/LSM-vs-BTREE/build/lsm $i a.csv > logs/lsm_${i}/a.log 2>&1
     # /mydata/LSM-vs-BTREE/build/lsm $i b.csv > logs/lsm_${i}/b.log 2>&1
     /mydata/LSM-vs-BTREE/build/lsm $i c.csv > logs/lsm_${i}/c.log 2>&1
+    # /mydata/LSM-vs-BTREE/build/lsm $i e.csv > logs/lsm_${i}/e.log 2>&1
     # ./scripts/set_uncore_frequency.sh
 done 
\ No newline at end of file